@@ -1 +1,52 @@
 #include "apu.hpp"
+
+namespace nes {
+
+void audio_processing_unit::save_state(state_writer& writer) const noexcept {
+    writer.write(frame_counter_);
+    writer.write(pulse1_);
+    writer.write(pulse2_);
+    writer.write(triangle_);
+    writer.write(noise_);
+    writer.write(dmc_);
+    writer.write(pending_cycles_);
+    writer.write(deadline_);
+    writer.write(check_output_);
+    writer.write(frame_clock_);
+    writer.write(channel_outputs_);
+    writer.write(amplitude_);
+    if constexpr (audio_synthesis_enabled) {
+        if (sampling_) {
+            sampling_->mixed.synthesis.save_state(writer);
+            return;
+        }
+    }
+    band_limited_synthesis::save_empty_state(writer);
+}
+
+void audio_processing_unit::load_state(state_reader& reader) noexcept {
+    reader.read(frame_counter_);
+    reader.read(pulse1_);
+    reader.read(pulse2_);
+    reader.read(triangle_);
+    reader.read(noise_);
+    reader.read(dmc_);
+    reader.read(pending_cycles_);
+    reader.read(deadline_);
+    reader.read(check_output_);
+    reader.read(frame_clock_);
+    reader.read(channel_outputs_);
+    reader.read(amplitude_);
+    if constexpr (audio_synthesis_enabled) {
+        if (sampling_) {
+            sampling_->mixed.synthesis.load_state(reader);
+            if (!sampling_->stems.empty()) {
+                reset_stems();
+            }
+            return;
+        }
+    }
+    band_limited_synthesis::skip_state(reader);
+}
+
+} // namespace nes
@@ -1,14 +1,24 @@
 #ifndef NES_APU_APU_HPP
 #define NES_APU_APU_HPP
 
+#include "cow_array.hpp"
 #include "dsp.hpp"
+#include "save_state.hpp"
 #include "types.hpp"
 #include <algorithm>
 #include <cassert>
+#include <limits>
 #include <span>
+#include <utility>
 
 namespace nes {
 
+#ifdef NES_DISABLE_AUDIO
+constexpr bool audio_synthesis_enabled = false;
+#else
+constexpr bool audio_synthesis_enabled = true;
+#endif
+
 namespace utility {
 
 constexpr void set_upper_byte(u16& destination, u8 value) noexcept {
@@ -44,7 +54,22 @@ class timer {
         }
     }
 
+    // steps until the step after which clock() is true
+    [[nodiscard]] constexpr std::size_t steps_until_clock() const noexcept {
+        return (counter_ == 0) ? (static_cast<std::size_t>(reload_value & mask) + 1) : counter_;
+    }
+
+    // same as that many calls of step(), which must all end before the next clock
+    constexpr void skip(std::size_t steps) noexcept {
+        assert(steps < steps_until_clock());
+        if (steps != 0) {
+            counter_ = (counter_ == 0) ? ((reload_value & mask) - (steps - 1)) : (counter_ - steps);
+        }
+    }
+
   private:
+    static constexpr u64 mask = (Bits == 64) ? ~u64{0} : ((u64{1} << (Bits % 64)) - 1);
+
     unterlying_type counter_ : Bits{};
 };
 
@@ -58,7 +83,7 @@ class frame_counter {
 
     constexpr void step() noexcept {
         ++cycle_count_;
-        if (cycle_count_ >= (sequencer_mode_ == mode::four_step ? 29830 : 37282)) {
+        if (cycle_count_ >= sequence_length()) {
             cycle_count_ = 0;
         }
 
@@ -86,11 +111,33 @@ class frame_counter {
     constexpr bool frame_interrupt() const noexcept { return frame_interrupt_; }
     constexpr void clear_frame_interrupt() noexcept { frame_interrupt_ = false; }
 
+    // cpu cycles until the cycle of the next clock, interrupt change or wrap around
+    [[nodiscard]] constexpr std::size_t cycles_until_event() const noexcept {
+        auto const length = sequence_length();
+        auto const next = std::ranges::upper_bound(events_, cycle_count_);
+        auto const event = (next == events_.end()) ? length : std::min(*next, length);
+        return (cycle_count_ + 1 >= length) ? 1 : (event - cycle_count_);
+    }
+
+    // same as that many calls of step(), which must all end before the next event
+    constexpr void skip(std::size_t cycles) noexcept {
+        assert(cycles < cycles_until_event());
+        cycle_count_ += cycles;
+    }
+
   private:
     enum class mode : bool {
         four_step,
         five_step,
-    } sequencer_mode_{};
+    };
+
+    static constexpr array<std::size_t, 7> events_{1, 7457, 14913, 22371, 29828, 29829, 37281};
+
+    constexpr std::size_t sequence_length() const noexcept {
+        return (sequencer_mode_ == mode::four_step) ? 29830 : 37282;
+    }
+
+    mode sequencer_mode_{};
     bool interrupt_inhibit_{};
     bool frame_interrupt_{};
     std::size_t cycle_count_{};
@@ -195,12 +242,13 @@ class sweep_generator {
 template <typename T, std::size_t Steps>
 class sequencer {
   public:
-    using range = std::span<T const, Steps>;
+    using range = array<T, Steps>;
     // has a sequence and an index into the sequence
     // pulse: 4 different 8-step-sequences of 1 and 0
     // triangle: 32-step-sequence 0..15
-    explicit constexpr sequencer(range sequence) noexcept : sequence_{sequence} {}
-    constexpr void set_sequence(range new_sequence) noexcept { sequence_ = new_sequence; }
+    // the sequence is copied so that the sequencer can be saved and restored with memcpy
+    explicit constexpr sequencer(range const& sequence) noexcept : sequence_{sequence} {}
+    constexpr void set_sequence(range const& new_sequence) noexcept { sequence_ = new_sequence; }
     constexpr void restart() noexcept { current_position_ = 0; }
     constexpr void step() noexcept { current_position_ = (current_position_ + 1) % Steps; }
     constexpr T output() const noexcept { return sequence_[current_position_]; }
@@ -283,6 +331,10 @@ class pulse_channel {
             sequencer_.step();
         }
     }
+    [[nodiscard]] constexpr std::size_t steps_until_clock() const noexcept {
+        return sequence_timer_.steps_until_clock();
+    }
+    constexpr void skip(std::size_t steps) noexcept { sequence_timer_.skip(steps); }
     constexpr void half_frame_step() noexcept {
         sequence_timer_.reload_value = sweep_.step(sequence_timer_.reload_value);
         length_counter_.step();
@@ -351,6 +403,10 @@ class triangle_channel {
             sequencer_.step();
         }
     }
+    [[nodiscard]] constexpr std::size_t steps_until_clock() const noexcept {
+        return sequence_timer_.steps_until_clock();
+    }
+    constexpr void skip(std::size_t steps) noexcept { sequence_timer_.skip(steps); }
 
     constexpr void quarter_frame_step() noexcept {
         if (linear_counter_reload_) {
@@ -425,6 +481,10 @@ class noise_channel {
             lfsr_ |= feedback;
         }
     }
+    [[nodiscard]] constexpr std::size_t steps_until_clock() const noexcept {
+        return timer_.steps_until_clock();
+    }
+    constexpr void skip(std::size_t steps) noexcept { timer_.skip(steps); }
 
     constexpr void quarter_frame_step() noexcept { envelope_.step(); }
 
@@ -453,20 +513,191 @@ class noise_channel {
     bool mode_{false};
 };
 
-class delta_modulation_channel {}; // TODO
+// plays 1 bit delta coded samples from cpu memory. the memory reader fetches a byte by dma
+// whenever the sample buffer is empty, the apu has to request it from the cpu bus.
+class delta_modulation_channel {
+  public:
+    enum class registers : u8 { flags_rate, direct_load, sample_address, sample_length };
+
+    constexpr delta_modulation_channel() noexcept { timer_.reload_value = rates_[0] - 1; }
+
+    constexpr void handle_register_write(registers register_select, u8 value) noexcept {
+        switch (register_select) {
+        case registers::flags_rate: {
+            // IL--.RRRR irq enabled, loop, rate
+            interrupt_enabled_ = (value & 0x80) != 0;
+            loop_ = (value & 0x40) != 0;
+            timer_.reload_value = static_cast<u16>(rates_[value & 0x0f] - 1);
+            if (!interrupt_enabled_) {
+                interrupt_ = false;
+            }
+        } break;
+        case registers::direct_load: {
+            output_level_ = value & 0x7f;
+        } break;
+        case registers::sample_address: {
+            sample_address_ = static_cast<u16>(0xc000 + (value * 64));
+        } break;
+        case registers::sample_length: {
+            sample_length_ = static_cast<u16>((value * 16) + 1);
+        } break;
+        default: assert(false);
+        }
+    }
+
+    // every cpu cycle
+    constexpr void step() noexcept {
+        timer_.step();
+        if (!timer_.clock()) {
+            return;
+        }
+
+        if (!silence_) {
+            if ((shift_register_ & 0x01) != 0) {
+                output_level_ = (output_level_ <= 125) ? (output_level_ + 2) : output_level_;
+            } else {
+                output_level_ = (output_level_ >= 2) ? (output_level_ - 2) : output_level_;
+            }
+        }
+        shift_register_ >>= 1;
+
+        if (--bits_remaining_ == 0) {
+            bits_remaining_ = 8;
+            silence_ = !sample_buffer_;
+            if (sample_buffer_) {
+                shift_register_ = *sample_buffer_;
+                sample_buffer_.reset();
+            }
+        }
+    }
+
+    [[nodiscard]] constexpr std::size_t steps_until_clock() const noexcept {
+        return timer_.steps_until_clock();
+    }
+    constexpr void skip(std::size_t steps) noexcept { timer_.skip(steps); }
+
+    // the memory reader wants the byte at dma_address()
+    [[nodiscard]] constexpr bool needs_sample() const noexcept {
+        return !sample_buffer_ && (bytes_remaining_ > 0);
+    }
+    [[nodiscard]] constexpr u16 dma_address() const noexcept { return current_address_; }
+
+    // cpu cycles until the sample buffer is emptied and the next byte is needed
+    [[nodiscard]] constexpr std::size_t cycles_until_fetch() const noexcept {
+        if (bytes_remaining_ == 0) {
+            return std::numeric_limits<std::size_t>::max();
+        }
+        if (!sample_buffer_) {
+            return 1;
+        }
+        return steps_until_clock() + ((bits_remaining_ - 1u) * (timer_.reload_value + 1u));
+    }
+
+    constexpr void load_sample(u8 value) noexcept {
+        assert(needs_sample());
+        sample_buffer_ = value;
+        current_address_ = (current_address_ == 0xffff) ? 0x8000 : (current_address_ + 1);
+        if (--bytes_remaining_ == 0) {
+            if (loop_) {
+                restart();
+            } else if (interrupt_enabled_) {
+                interrupt_ = true;
+            }
+        }
+    }
+
+    constexpr void enable() noexcept {
+        if (bytes_remaining_ == 0) {
+            restart();
+        }
+    }
+    constexpr void disable() noexcept { bytes_remaining_ = 0; }
+    [[nodiscard]] constexpr bool enabled() const noexcept { return bytes_remaining_ > 0; }
+
+    [[nodiscard]] constexpr bool interrupt() const noexcept { return interrupt_; }
+    constexpr void clear_interrupt() noexcept { interrupt_ = false; }
+
+    constexpr u8 output() const noexcept { return output_level_; }
+
+  private:
+    // cpu cycles per output bit
+    static constexpr array<u16, 16> rates_{
+        {428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54}};
+
+    constexpr void restart() noexcept {
+        current_address_ = sample_address_;
+        bytes_remaining_ = sample_length_;
+    }
+
+    timer<9> timer_{};
+    u8 output_level_{0};
+    u8 shift_register_{0};
+    u8 bits_remaining_{8};
+    bool silence_{true};
+    optional<u8> sample_buffer_;
+
+    u16 sample_address_{0xc000};
+    u16 sample_length_{1};
+    u16 current_address_{0xc000};
+    u16 bytes_remaining_{0};
+    bool loop_{false};
+    bool interrupt_enabled_{false};
+    bool interrupt_{false};
+};
+
+enum class audio_channel : u8 { pulse1, pulse2, triangle, noise, dmc };
+constexpr std::size_t audio_channel_count = 5;
+
+// the nonlinear mixer as tables of the weighted sums of the channel outputs (nesdev wiki)
+constexpr auto pulse_table = [] {
+    array<float, 31> table{};
+    for (std::size_t n = 1; n < table.size(); ++n) {
+        table[n] = static_cast<float>(95.52 / ((8128.0 / static_cast<double>(n)) + 100.0));
+    }
+    return table;
+}();
+constexpr auto tnd_table = [] {
+    array<float, 203> table{};
+    for (std::size_t n = 1; n < table.size(); ++n) {
+        table[n] = static_cast<float>(163.67 / ((24329.0 / static_cast<double>(n)) + 100.0));
+    }
+    return table;
+}();
 
 constexpr float mix(u8 pulse1, u8 pulse2, u8 triangle, u8 noise, u8 dmc) noexcept {
-    auto const pulse_out = 95.88 / ((8128.0 / (pulse1 + pulse2)) + 100.0);
-    auto const tnd_out =
-        159.79 / ((1.0 / ((triangle / 8227.0) + (noise / 12241.0) + (dmc / 22638.0))) + 100.0);
-    return static_cast<float>(pulse_out + tnd_out);
+    return pulse_table[pulse1 + pulse2] + tnd_table[(3 * triangle) + (2 * noise) + dmc];
 }
 
+// the level of one channel as if the others were silent
+constexpr float mix_alone(audio_channel channel, u8 output) noexcept {
+    switch (channel) {
+    case audio_channel::pulse1:
+    case audio_channel::pulse2: return pulse_table[output];
+    case audio_channel::triangle: return tnd_table[3 * output];
+    case audio_channel::noise: return tnd_table[2 * output];
+    case audio_channel::dmc: return tnd_table[output];
+    }
+    return 0.0f;
+}
+
+// the apu is emulated lazily (catch-up): step() only counts cpu cycles, and the counted cycles
+// are emulated when the state is observed. that is at register accesses, the frame counter
+// events (which may change the interrupt), the dmc sample fetches and the end of the frame.
+// between two timer clocks nothing happens but counting down, so the cycles in between are
+// skipped in one go and the time spent depends on the number of audio events instead of the
+// number of cpu cycles.
 class audio_processing_unit {
   public:
-    static constexpr std::size_t sample_rate = 44100;
+    static constexpr double default_sample_rate = 44100.0;
+    static constexpr double clock_rate = 1789773.0; // cpu cycles per second
+
+    audio_processing_unit() {
+        if constexpr (audio_synthesis_enabled) {
+            sampling_.emplace(sample_rate_);
+        }
+    }
 
-    constexpr u8 read(u16 address) noexcept {
+    u8 read(u16 address) noexcept {
         assert(address >= 0x4000);
         assert(address < 0x4018);
         assert(address != 0x4014);
@@ -475,19 +706,22 @@ class audio_processing_unit {
             return 0;
         }
 
+        catch_up();
         auto const frame_interrupt = frame_counter_.frame_interrupt();
         frame_counter_.clear_frame_interrupt();
 
-        // TODO: dmc, dmc interrupt
         return ((pulse1_.enabled() << 0) & 0x01) | ((pulse2_.enabled() << 1) & 0x02) |
                ((triangle_.enabled() << 2) & 0x04) | ((noise_.enabled() << 3) & 0x08) |
-               ((frame_interrupt << 7) & 0x40);
+               ((dmc_.enabled() << 4) & 0x10) | ((frame_interrupt << 6) & 0x40) |
+               ((dmc_.interrupt() << 7) & 0x80);
     }
-    constexpr void write(u16 address, u8 value) noexcept {
+    void write(u16 address, u8 value) noexcept {
         assert(address >= 0x4000);
         assert(address < 0x4018);
         assert(address != 0x4014);
 
+        catch_up();
+        check_output_ = true;
         address %= 0x4000;
 
         if (address < 0x08) {
@@ -501,10 +735,10 @@ class audio_processing_unit {
             auto const noise_register = static_cast<noise_channel::registers>(address % 4);
             noise_.handle_register_write(noise_register, value);
         } else if (address < 0x14) {
-            // dmc
+            auto const dmc_register = static_cast<delta_modulation_channel::registers>(address % 4);
+            dmc_.handle_register_write(dmc_register, value);
         } else if (address == 0x15) {
             // status
-            // TODO: dmc
             // TODO: cleaner with enable(bool) ?
             if ((value & 0x01) != 0) {
                 pulse1_.enable();
@@ -526,24 +760,202 @@ class audio_processing_unit {
             } else {
                 noise_.disable();
             }
+            if ((value & 0x10) != 0) {
+                dmc_.enable();
+            } else {
+                dmc_.disable();
+            }
+            dmc_.clear_interrupt();
         } else if (address == 0x17) {
             frame_counter_.handle_register_write(value);
         }
+        update_deadline();
     }
 
     [[nodiscard]] constexpr bool interrupt() const noexcept {
-        return frame_counter_.frame_interrupt(); // TODO dmc?
+        return frame_counter_.frame_interrupt() || dmc_.interrupt();
     }
 
-    // every cpu cycle
-    constexpr void step() noexcept {
-        frame_counter_.step();
-        triangle_.step();
+    // the dmc wants the byte at dma_address(). the system reads it and hands it over with
+    // complete_dma(), which stalls the cpu. step() reports when a request comes up.
+    [[nodiscard]] constexpr bool dma_request() const noexcept { return dmc_.needs_sample(); }
+    [[nodiscard]] constexpr u16 dma_address() const noexcept { return dmc_.dma_address(); }
+    void complete_dma(u8 value) noexcept {
+        catch_up();
+        dmc_.load_sample(value);
+        update_deadline();
+    }
+
+    // every cpu cycle. true when there is a dma request, which is only checked at the deadline
+    // because the fetches are part of it.
+    constexpr bool step() noexcept {
+        if (++pending_cycles_ == deadline_) {
+            catch_up();
+            return dmc_.needs_sample();
+        }
+        return false;
+    }
+
+    // makes the samples since the last call available, called at the end of every frame.
+    // returns the number of samples of the frame.
+    std::size_t end_frame() noexcept {
+        catch_up();
+        flush_samples();
+        return std::exchange(frame_samples_, 0);
+    }
+
+    // returns span of all samples written since last call
+    std::span<float const> get_sample_buffer() noexcept {
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                return sampling_->mixed.take();
+            }
+        }
+        return {};
+    }
+
+    // every channel on its own besides the mix (e.g. for analysis). between frames.
+    void enable_stems() {
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_ && sampling_->stems.empty()) {
+                reset_stems();
+            }
+        }
+    }
+    void disable_stems() noexcept {
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                sampling_->stems = {};
+            }
+        }
+    }
+
+    // samples of one channel since the last call, as many as get_sample_buffer returns
+    std::span<float const> get_stem_buffer(audio_channel channel) noexcept {
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_ && !sampling_->stems.empty()) {
+                return sampling_->stems[static_cast<std::size_t>(channel)].take();
+            }
+        }
+        return {};
+    }
+
+    // output rate, can be adjusted every frame (e.g. to keep an audio device queue filled)
+    void set_sample_rate(double sample_rate) noexcept {
+        assert(frame_clock_ == 0);
+        sample_rate_ = sample_rate;
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                sampling_->mixed.synthesis.set_sample_rate(sample_rate);
+                for (auto& stem : sampling_->stems) {
+                    stem.synthesis.set_sample_rate(sample_rate);
+                }
+                sampling_->max_frame_clock = sampling_->mixed.synthesis.max_frame_duration();
+            }
+        }
+    }
+
+    // without audio only what the cpu can observe is emulated: the length counters, the status
+    // register and the frame interrupt. the channel timers stand still and the synthesis and
+    // sample buffers are freed. between frames.
+    void enable_audio() {
+        if constexpr (audio_synthesis_enabled) {
+            if (!sampling_) {
+                sampling_.emplace(sample_rate_);
+                check_output_ = true;
+            }
+        }
+    }
+    void disable_audio() noexcept {
+        assert(frame_clock_ == 0);
+        sampling_.reset();
+    }
+
+    // no samples are produced if disabled
+    constexpr void set_output_enabled(bool enabled) noexcept {
+        output_enabled_ = enabled;
+        check_output_ = true;
+    }
+
+    // the sample buffers are not part of the state, stems restart at the loaded state
+    void save_state(state_writer& writer) const noexcept;
+    void load_state(state_reader& reader) noexcept;
+
+  private:
+    // emulates the counted cycles
+    void catch_up() noexcept {
+        while (pending_cycles_ > 0) {
+            auto const skipped = std::min(cycles_until_event() - 1, pending_cycles_);
+            skip(skipped);
+            pending_cycles_ -= skipped;
+            if (pending_cycles_ > 0) {
+                run_cycle();
+                --pending_cycles_;
+            }
+        }
+        update_deadline();
+    }
+
+    // the state is observable at frame counter events and when the dmc needs the next byte
+    void update_deadline() noexcept {
+        deadline_ = std::min(frame_counter_.cycles_until_event(), dmc_.cycles_until_fetch());
+    }
+
+    // cpu cycles until the cycle of the next timer clock, frame counter event, output change
+    // after a register write or the end of the synthesis buffer. the dmc timer runs without
+    // audio too, it drives the sample fetches.
+    [[nodiscard]] std::size_t cycles_until_event() const noexcept {
+        auto const observable =
+            std::min(frame_counter_.cycles_until_event(), dmc_.steps_until_clock());
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                return check_output_ ? 1 : std::min(observable, cycles_until_sampling_event());
+            }
+        }
+        return observable;
+    }
+
+    // with sampling: cycles until the next channel timer clock or the end of the synthesis buffer
+    [[nodiscard]] std::size_t cycles_until_sampling_event() const noexcept {
+        // pulse and noise timers are clocked on the odd cycles of the frame counter
+        auto const odd_cycle = frame_counter_.apu_clock() ? 0 : 1;
+        auto const apu_clock_cycles = [&](std::size_t steps) { return (2 * steps) - odd_cycle; };
+        return std::min({triangle_.steps_until_clock(),
+                         apu_clock_cycles(pulse1_.steps_until_clock()),
+                         apu_clock_cycles(pulse2_.steps_until_clock()),
+                         apu_clock_cycles(noise_.steps_until_clock()),
+                         std::size_t{sampling_->max_frame_clock - frame_clock_}});
+    }
 
-        if (frame_counter_.apu_clock()) {
-            pulse1_.step();
-            pulse2_.step();
-            noise_.step();
+    // same as that many calls of run_cycle(), which must all end before the next event
+    void skip(std::size_t cycles) noexcept {
+        auto const odd_cycle = frame_counter_.apu_clock() ? 0 : 1;
+        auto const apu_clocks = (cycles + odd_cycle) / 2;
+        frame_counter_.skip(cycles);
+        dmc_.skip(cycles);
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                triangle_.skip(cycles);
+                pulse1_.skip(apu_clocks);
+                pulse2_.skip(apu_clocks);
+                noise_.skip(apu_clocks);
+                frame_clock_ += static_cast<u32>(cycles);
+            }
+        }
+    }
+
+    void run_cycle() noexcept {
+        frame_counter_.step();
+        dmc_.step();
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                triangle_.step();
+                if (frame_counter_.apu_clock()) {
+                    pulse1_.step();
+                    pulse2_.step();
+                    noise_.step();
+                }
+            }
         }
 
         if (frame_counter_.quarter_frame_clock()) {
@@ -560,56 +972,110 @@ class audio_processing_unit {
             noise_.half_frame_step();
         }
 
-        // 2x oversampling
-        constexpr double cycles_per_sample = 1789773.0 / (sample_rate * 2);
-        cpu_cycle_count_ += 1.0;
-        if (cpu_cycle_count_ > cycles_per_sample) {
-            cpu_cycle_count_ -= cycles_per_sample;
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_) {
+                synthesize_output();
+            }
+        }
+    }
 
+    // with sampling: adds the output changes of this cycle to the synthesis buffers
+    void synthesize_output() noexcept {
+        // only changes of the output are synthesized
+        check_output_ = false;
+        if (output_enabled_) {
             // TODO: stereo panning of channels would be cool
+            array<u8, audio_channel_count> const outputs{
+                pulse1_.output(), pulse2_.output(), triangle_.output(), noise_.output(),
+                dmc_.output()};
+            if (outputs != channel_outputs_) {
+                auto& stems = sampling_->stems; // empty unless enabled
+                for (std::size_t i = 0; i < stems.size(); ++i) {
+                    if (outputs[i] != channel_outputs_[i]) {
+                        auto const level = mix_alone(static_cast<audio_channel>(i), outputs[i]);
+                        stems[i].synthesis.add_delta(frame_clock_,
+                                                     level - sampling_->stem_levels[i]);
+                        sampling_->stem_levels[i] = level;
+                    }
+                }
 
-            lpf.push_back(hpf.process(
-                mix(pulse1_.output(), pulse2_.output(), triangle_.output(), noise_.output(), 0)));
-
-            // downsample by writing every second sample
-            if (write_sample) {
-                *write_pointer_++ = lpf.calculate_filtered_sample();
+                channel_outputs_ = outputs;
+                auto const amplitude =
+                    mix(outputs[0], outputs[1], outputs[2], outputs[3], outputs[4]);
+                sampling_->mixed.synthesis.add_delta(frame_clock_, amplitude - amplitude_);
+                amplitude_ = amplitude;
             }
-            write_sample = !write_sample;
+        }
 
-            if (write_pointer_ == sample_buffer_.end()) {
-                write_pointer_ = sample_buffer_.begin();
-            }
+        if (++frame_clock_ == sampling_->max_frame_clock) {
+            flush_samples(); // the frame is too long for the synthesis buffer
         }
     }
 
-    // copies the requested number of samples into the destination buffer (for audio callback)
-    // if there are not enough samples, the remaining samples are filled with silence
-    void read_samples(std::span<float> destination) noexcept {
-        auto begin = destination.begin();
-        while (begin != destination.end()) {
-            if (read_pointer_ == write_pointer_) {
-                // not enough samples: fill with silence
-                *begin++ = 0.0f;
-            } else {
-                // copy sample
-                *begin++ = *read_pointer_++;
-            }
-            if (read_pointer_ == sample_buffer_.end()) {
-                read_pointer_ = sample_buffer_.begin();
+    void flush_samples() noexcept {
+        if constexpr (audio_synthesis_enabled) {
+            if (sampling_ && output_enabled_) {
+                frame_samples_ += sampling_->mixed.end_frame(frame_clock_);
+                for (auto& stem : sampling_->stems) {
+                    stem.end_frame(frame_clock_);
+                }
             }
         }
+        frame_clock_ = 0;
     }
 
-    // returns span of all samples written since last call (for audio queue)
-    std::span<float const> get_sample_buffer() noexcept {
-        // not using read pointer with this approach
-        std::size_t const length = std::distance(sample_buffer_.begin(), write_pointer_);
-        write_pointer_ = sample_buffer_.begin();
-        return {sample_buffer_.data(), length};
+    // (re)starts the stems at the current channel outputs
+    void reset_stems() {
+        auto& stems = sampling_->stems;
+        auto& levels = sampling_->stem_levels;
+        stems.assign(audio_channel_count, sample_stream{sample_rate_});
+        for (std::size_t i = 0; i < stems.size(); ++i) {
+            levels[i] = mix_alone(static_cast<audio_channel>(i), channel_outputs_[i]);
+            stems[i].synthesis.add_delta(frame_clock_, levels[i]);
+        }
     }
 
-  private:
+    // band-limited samples of one signal, collected until they are taken
+    struct sample_stream {
+        explicit sample_stream(double sample_rate) : synthesis{clock_rate, sample_rate, 37.0} {}
+
+        // returns the number of new samples
+        std::size_t end_frame(u32 duration) noexcept {
+            synthesis.end_frame(duration);
+            std::size_t count = 0;
+            while (synthesis.samples_available() > 0) {
+                auto const read =
+                    synthesis.read_samples(buffer.writable().subspan(write_pointer));
+                count += read;
+                write_pointer += read;
+                if (write_pointer == buffer.size()) {
+                    write_pointer = 0;
+                }
+            }
+            return count;
+        }
+
+        std::span<float const> take() noexcept {
+            std::size_t const length = write_pointer;
+            write_pointer = 0;
+            return {buffer.data(), length};
+        }
+
+        band_limited_synthesis synthesis;
+        cow_array<float, 44100> buffer;
+        std::size_t write_pointer{0};
+    };
+
+    // only allocated with audio
+    struct sampling {
+        explicit sampling(double sample_rate) : mixed{sample_rate} {}
+
+        sample_stream mixed;
+        u32 max_frame_clock{mixed.synthesis.max_frame_duration()};
+        vector<sample_stream> stems;
+        array<float, audio_channel_count> stem_levels{};
+    };
+
     frame_counter frame_counter_{};
     pulse_channel pulse1_{};
     pulse_channel pulse2_{};
@@ -617,14 +1083,19 @@ class audio_processing_unit {
     noise_channel noise_{};
     delta_modulation_channel dmc_{};
 
+    // catch-up
+    std::size_t pending_cycles_{0}; // counted, not yet emulated
+    std::size_t deadline_{frame_counter_.cycles_until_event()}; // pending cycles to catch up at
+    bool check_output_{true}; // the outputs may have changed outside of a timer clock
+
     // sampling
-    double cpu_cycle_count_{};
-    vector<float> sample_buffer_ = vector<float>(44100); // TODO: ring buffer type
-    vector<float>::iterator write_pointer_{sample_buffer_.begin()};
-    vector<float>::iterator read_pointer_{sample_buffer_.begin()};
-    first_order_highpass_filter<sample_rate, 37> hpf;
-    antialiasing_filter lpf;
-    bool write_sample = false;
+    u32 frame_clock_{0}; // cpu cycles since the last end_frame
+    array<u8, audio_channel_count> channel_outputs_{};
+    float amplitude_{mix(0, 0, 0, 0, 0)};
+    std::size_t frame_samples_{0}; // since the last end_frame, not part of the state
+    double sample_rate_{default_sample_rate};
+    optional<sampling> sampling_;
+    bool output_enabled_{true};
 };
 
 } // namespace nes
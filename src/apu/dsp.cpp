@@ -1,37 +1,158 @@
 #include "dsp.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
 
 namespace nes {
 
-void antialiasing_filter::push_back(float input) noexcept {
-    history_[last_index_++] = input;
-    if (last_index_ == tap_num) {
-        last_index_ = 0;
+namespace {
+
+constexpr unsigned phase_bits = 6;
+constexpr std::size_t phase_count = 1u << phase_bits;
+constexpr std::size_t kernel_width = band_limited_synthesis::kernel_width;
+
+using kernel_table = array<array<float, kernel_width>, phase_count + 1>;
+
+// impulse for every fractional position of the impulse between two samples. blackman windowed
+// sinc with the cutoff at 90% of nyquist, every phase sums to 1 so that steps have no error.
+kernel_table make_kernels() noexcept {
+    constexpr double cutoff = 0.45; // in cycles per sample
+    constexpr double half_width = kernel_width / 2.0;
+    constexpr auto pi = std::numbers::pi;
+
+    kernel_table kernels{};
+    for (std::size_t phase = 0; phase <= phase_count; ++phase) {
+        auto const center = (half_width - 1.0) + (static_cast<double>(phase) / phase_count);
+
+        array<double, kernel_width> taps{};
+        for (std::size_t i = 0; i < kernel_width; ++i) {
+            auto const x = static_cast<double>(i) - center;
+            auto const arg = 2 * pi * cutoff * x;
+            auto const sinc = (x == 0.0) ? 1.0 : std::sin(arg) / arg;
+            auto const window = (std::abs(x) >= half_width)
+                                    ? 0.0
+                                    : 0.42 + (0.5 * std::cos(pi * x / half_width)) +
+                                          (0.08 * std::cos(2 * pi * x / half_width));
+            taps[i] = sinc * window;
+        }
+
+        double sum = 0.0;
+        for (auto const tap : taps) {
+            sum += tap;
+        }
+        std::ranges::transform(taps, kernels[phase].begin(),
+                               [&](double tap) { return static_cast<float>(tap / sum); });
+    }
+    return kernels;
+}
+
+} // namespace
+
+band_limited_synthesis::band_limited_synthesis(double clock_rate, double sample_rate,
+                                               double highpass_hz) noexcept
+    : clock_rate_{clock_rate}, highpass_hz_{highpass_hz} {
+    set_sample_rate(sample_rate);
+}
+
+void band_limited_synthesis::set_sample_rate(double sample_rate) noexcept {
+    assert(sample_rate > 0.0);
+    samples_per_clock_ = static_cast<u64>(
+        std::llround(sample_rate / clock_rate_ * static_cast<double>(u64{1} << time_bits)));
+    leak_ = static_cast<float>(2 * std::numbers::pi * highpass_hz_ / sample_rate);
+}
+
+void band_limited_synthesis::add_delta(u32 time, float delta) noexcept {
+    static kernel_table const kernels = make_kernels();
+
+    auto const position = offset_ + (time * samples_per_clock_);
+    auto const index = static_cast<std::size_t>(position >> time_bits);
+    assert(index < buffer_size);
+
+    // linear interpolation between the two closest phases
+    constexpr unsigned interpolation_bits = 16;
+    auto const fraction =
+        static_cast<u32>(position) >> (time_bits - phase_bits - interpolation_bits);
+    auto const phase = fraction >> interpolation_bits;
+    auto const weight = static_cast<float>(fraction & 0xffff) * (1.0f / 65536.0f);
+
+    auto const& first = kernels[phase];
+    auto const& second = kernels[phase + 1];
+    auto const second_delta = delta * weight;
+    auto const first_delta = delta - second_delta;
+
+    // two fixed width loops over local data, which the compiler vectorizes without alias checks
+    array<float, kernel_width> impulse{};
+    for (std::size_t i = 0; i < kernel_width; ++i) {
+        impulse[i] = (first[i] * first_delta) + (second[i] * second_delta);
     }
+    auto const samples = buffer_.writable().subspan(index).first<kernel_width>();
+    for (std::size_t i = 0; i < kernel_width; ++i) {
+        samples[i] += impulse[i];
+    }
+}
+
+void band_limited_synthesis::end_frame(u32 duration) noexcept {
+    offset_ += duration * samples_per_clock_;
+    assert(samples_available() <= buffer_size);
+}
+
+u32 band_limited_synthesis::max_frame_duration() const noexcept {
+    auto const free = (u64{buffer_size - 1} << time_bits) - offset_;
+    return static_cast<u32>(free / samples_per_clock_);
+}
+
+std::size_t band_limited_synthesis::read_samples(std::span<float> destination) noexcept {
+    auto const available = samples_available();
+    auto const count = std::min(destination.size(), available);
+    if (count == 0) {
+        return 0;
+    }
+
+    auto const buffer = buffer_.writable();
+    auto integrator = integrator_;
+    for (std::size_t i = 0; i < count; ++i) {
+        integrator += buffer[i];
+        destination[i] = integrator;
+        integrator -= integrator * leak_;
+    }
+    integrator_ = integrator;
+
+    // unread samples and the tails of the last impulses move to the front
+    auto const used = available + kernel_width;
+    std::copy(buffer.begin() + count, buffer.begin() + used, buffer.begin());
+    std::fill(buffer.begin() + (used - count), buffer.begin() + used, 0.0f);
+    offset_ -= u64{count} << time_bits;
+    return count;
+}
+
+void band_limited_synthesis::save_state(state_writer& writer) const noexcept {
+    writer.write(offset_);
+    writer.write(integrator_);
+    writer.write_bytes(std::as_bytes(buffer_.view().first<kernel_width>()));
+}
+
+void band_limited_synthesis::load_state(state_reader& reader) noexcept {
+    reader.read(offset_);
+    reader.read(integrator_);
+    auto const buffer = buffer_.writable();
+    std::ranges::fill(buffer, 0.0f);
+    reader.read_bytes(std::as_writable_bytes(buffer.first<kernel_width>()));
+}
+
+void band_limited_synthesis::save_empty_state(state_writer& writer) noexcept {
+    writer.write(u64{0});
+    writer.write(0.0f);
+    writer.write(array<float, kernel_width>{});
 }
 
-float antialiasing_filter::calculate_filtered_sample() noexcept {
-    static constexpr array<double, tap_num> filter_taps{
-        {-0.000165371425938316,  -0.0010142366677726668, -0.0031915882103072985,
-         -0.006473383207434769,  -0.00858335618521196,   -0.005688368443273637,
-         0.004178793334531979,   0.016591628711275536,   0.02030909322310278,
-         0.004928485816587725,   -0.02658527078058321,   -0.05151827373029294,
-         -0.03730493935172431,   0.034555098175678936,   0.14772597039690868,
-         0.2528709265676202,     0.2957421307452675,     0.2528709265676202,
-         0.14772597039690868,    0.034555098175678936,   -0.03730493935172431,
-         -0.05151827373029294,   -0.02658527078058321,   0.004928485816587725,
-         0.02030909322310278,    0.016591628711275536,   0.004178793334531979,
-         -0.005688368443273637,  -0.00858335618521196,   -0.006473383207434769,
-         -0.0031915882103072985, -0.0010142366677726668, -0.000165371425938316}};
-
-    // TODO: write an iterable ring buffer and use std::accumulate
-    double acc = 0;
-    std::size_t index = last_index_;
-    for (int i = 0; i < tap_num; ++i) {
-        index = (index != 0) ? (index - 1) : (tap_num - 1);
-        acc += history_[index] * filter_taps[i];
-    };
-
-    return static_cast<float>(acc);
+void band_limited_synthesis::skip_state(state_reader& reader) noexcept {
+    u64 offset{};
+    float integrator{};
+    array<float, kernel_width> tail{};
+    reader.read(offset);
+    reader.read(integrator);
+    reader.read(tail);
 }
 
 } // namespace nes
@@ -1,42 +1,64 @@
 #ifndef NES_APU_DSP_HPP
 #define NES_APU_DSP_HPP
 
+#include "../cow_array.hpp"
+#include "../save_state.hpp"
 #include "../types.hpp"
-#include <numbers>
+#include <span>
 
 namespace nes {
 
-// first order iir highpass filter stolen from wikipedia
-template <std::size_t SampleRateHz, std::size_t CutoffFrequencyHz>
-class first_order_highpass_filter {
+// band-limited synthesis of a signal that is given by its amplitude changes (after blargg's
+// blip_buf). every change adds a band-limited impulse (windowed sinc) at its exact clock time
+// to the samples around it, the samples are integrated when they are read. this turns the
+// changes into band-limited steps, so square waves do not alias, and only the changes cost
+// time instead of every clock.
+// the integrator leaks a little, which makes it a first order highpass (dc blocker) as well.
+class band_limited_synthesis {
   public:
-    constexpr float process(float x) noexcept {
-        float const y = alpha_ * (last_y_ + x - last_x_);
-        last_y_ = y;
-        last_x_ = x;
-        return y;
+    static constexpr std::size_t kernel_width = 16;
+    static constexpr std::size_t buffer_size = 4096; // samples
+
+    band_limited_synthesis(double clock_rate, double sample_rate, double highpass_hz) noexcept;
+
+    // the ratio of sample rate and clock rate can change between frames with sub-ppm precision,
+    // which allows to follow the rate of an audio device
+    void set_sample_rate(double sample_rate) noexcept;
+
+    // time in clocks since the start of the frame
+    void add_delta(u32 time, float delta) noexcept;
+
+    // ends the frame after duration clocks and makes its samples available
+    void end_frame(u32 duration) noexcept;
+
+    // longest frame that fits into the buffer
+    [[nodiscard]] u32 max_frame_duration() const noexcept;
+
+    [[nodiscard]] std::size_t samples_available() const noexcept {
+        return static_cast<std::size_t>(offset_ >> time_bits);
     }
 
-  private:
-    static constexpr float alpha_ = static_cast<float>(
-        1.0 / (2 * std::numbers::pi * (1.0 / SampleRateHz) * CutoffFrequencyHz + 1.0));
+    // removes up to destination.size() samples from the buffer, returns the number of samples
+    std::size_t read_samples(std::span<float> destination) noexcept;
 
-    float last_y_ = 0.0f;
-    float last_x_ = 0.0f;
-};
+    // only complete at the end of a frame, when all samples are read: the partial frame is lost
+    void save_state(state_writer& writer) const noexcept;
+    void load_state(state_reader& reader) noexcept;
 
-// fir lowpass filter generated with t-filter.engineeringjs.com
-// samplerate 88.2kHz, passband <=10kHz, stopband >=20kHz with >100dB attenuation
-class antialiasing_filter {
-  public:
-    void push_back(float input) noexcept;
-    float calculate_filtered_sample() noexcept;
+    // the same layout without an instance, for the states of emulators without audio
+    static void save_empty_state(state_writer& writer) noexcept;
+    static void skip_state(state_reader& reader) noexcept;
 
   private:
-    static constexpr std::size_t tap_num = 33;
+    static constexpr unsigned time_bits = 32; // fractional bits of sample times
 
-    array<double, tap_num> history_{};
-    std::size_t last_index_{};
+    double clock_rate_;
+    double highpass_hz_;
+    u64 samples_per_clock_{};
+    u64 offset_{0}; // start of the frame in samples, relative to the first unread sample
+    float leak_{};
+    float integrator_{0.0f};
+    cow_array<float, buffer_size + kernel_width> buffer_;
 };
 
 } // namespace nes
@@ -0,0 +1,105 @@
+#include "audio_capture.hpp"
+#include <ostream>
+
+namespace nes {
+
+namespace {
+
+// the canonical 44 byte header with a 16 byte format chunk
+struct wav_header {
+    array<char, 4> riff_id{'R', 'I', 'F', 'F'};
+    u32 riff_size;
+    array<char, 4> wave_id{'W', 'A', 'V', 'E'};
+    array<char, 4> format_id{'f', 'm', 't', ' '};
+    u32 format_size{16};
+    u16 format_tag{3}; // ieee float
+    u16 channels{1};
+    u32 sample_rate;
+    u32 byte_rate;
+    u16 block_align{sizeof(float)};
+    u16 bits_per_sample{8 * sizeof(float)};
+    array<char, 4> data_id{'d', 'a', 't', 'a'};
+    u32 data_size;
+};
+static_assert(sizeof(wav_header) == 44);
+
+void write_wav_header(std::ostream& out, u32 sample_rate, u64 samples) {
+    auto const data_size = static_cast<u32>(samples * sizeof(float));
+    wav_header header{};
+    header.riff_size = static_cast<u32>(sizeof(wav_header) - 8 + data_size);
+    header.sample_rate = sample_rate;
+    header.byte_rate = static_cast<u32>(sample_rate * sizeof(float));
+    header.data_size = data_size;
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+}
+
+} // namespace
+
+audio_file_format audio_file_format_for(std::filesystem::path const& file) {
+    return (file.extension() == ".wav") ? audio_file_format::wav : audio_file_format::raw;
+}
+
+audio_file_writer::audio_file_writer(std::ostream& out, audio_file_format format,
+                                     u32 sample_rate)
+    : out_{out}, format_{format}, sample_rate_{sample_rate} {
+    if (format_ == audio_file_format::wav) {
+        write_wav_header(out_, sample_rate_, 0);
+    }
+}
+
+void audio_file_writer::write(std::span<float const> samples) {
+    out_.write(reinterpret_cast<char const*>(samples.data()),
+               static_cast<std::streamsize>(samples.size_bytes()));
+    samples_written_ += samples.size();
+}
+
+void audio_file_writer::finish() {
+    if (format_ == audio_file_format::wav) {
+        auto const end = out_.tellp();
+        out_.seekp(0);
+        write_wav_header(out_, sample_rate_, samples_written_);
+        out_.seekp(end);
+    }
+    out_.flush();
+}
+
+audio_capture::audio_capture(std::ostream& out, audio_file_format format, u32 sample_rate,
+                             std::size_t buffer_samples)
+    : writer_{out, format, sample_rate}, ring_{buffer_samples},
+      thread_{[this] { write_samples(); }} {}
+
+audio_capture::~audio_capture() {
+    stop_.store(true, std::memory_order_release);
+    pushes_.fetch_add(1, std::memory_order_release);
+    pushes_.notify_one();
+    thread_.join();
+    writer_.finish();
+}
+
+void audio_capture::push(std::span<float const> samples) noexcept {
+    auto const count = ring_.push(samples);
+    dropped_samples_ += samples.size() - count;
+    pushes_.fetch_add(1, std::memory_order_release);
+    pushes_.notify_one();
+}
+
+void audio_capture::write_samples() {
+    vector<float> chunk(4096);
+    auto const drain = [&] {
+        while (auto const count = ring_.pop(chunk)) {
+            writer_.write(std::span{chunk}.first(count));
+        }
+    };
+
+    for (;;) {
+        auto const pushes = pushes_.load(std::memory_order_acquire);
+        drain();
+        if (stop_.load(std::memory_order_acquire)) {
+            drain(); // what was pushed before the stop
+            return;
+        }
+        pushes_.wait(pushes, std::memory_order_acquire);
+    }
+}
+
+} // namespace nes
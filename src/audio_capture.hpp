@@ -0,0 +1,69 @@
+#ifndef NES_AUDIO_CAPTURE_HPP
+#define NES_AUDIO_CAPTURE_HPP
+
+#include "spsc_ring.hpp"
+#include "types.hpp"
+#include <atomic>
+#include <filesystem>
+#include <iosfwd>
+#include <span>
+#include <thread>
+
+namespace nes {
+
+enum class audio_file_format : u8 { wav, raw };
+
+// wav for files ending in .wav, raw otherwise
+audio_file_format audio_file_format_for(std::filesystem::path const& file);
+
+// writes mono 32 bit float samples as wav (ieee float) or as raw pcm without a header
+class audio_file_writer {
+  public:
+    audio_file_writer(std::ostream& out, audio_file_format format, u32 sample_rate);
+
+    void write(std::span<float const> samples);
+
+    // fills in the sizes of the wav header, the stream has to be seekable
+    void finish();
+
+    [[nodiscard]] u64 samples_written() const noexcept { return samples_written_; }
+
+  private:
+    std::ostream& out_;
+    audio_file_format format_;
+    u32 sample_rate_;
+    u64 samples_written_{0};
+};
+
+// records the samples of every frame on a background thread. push() copies them into a lock-free
+// ring and returns, so the emulation never waits for the disk. samples that do not fit because
+// the disk is too slow are dropped and counted. the file is complete after destruction.
+class audio_capture {
+  public:
+    // the stream is only used by the writer thread until destruction
+    audio_capture(std::ostream& out, audio_file_format format, u32 sample_rate,
+                  std::size_t buffer_samples = std::size_t{1} << 20);
+    ~audio_capture();
+
+    audio_capture(audio_capture const&) = delete;
+    audio_capture& operator=(audio_capture const&) = delete;
+
+    // emulation thread, e.g. nes.sample_buffer() at the end of every frame
+    void push(std::span<float const> samples) noexcept;
+
+    [[nodiscard]] u64 dropped_samples() const noexcept { return dropped_samples_; }
+
+  private:
+    void write_samples();
+
+    audio_file_writer writer_;
+    spsc_ring<float> ring_;
+    std::atomic<u64> pushes_{0}; // the writer thread sleeps until this changes
+    std::atomic<bool> stop_{false};
+    u64 dropped_samples_{0};
+    std::jthread thread_; // last, it uses the members above
+};
+
+} // namespace nes
+
+#endif
@@ -0,0 +1,37 @@
+#include "batch_runner.hpp"
+#include "hash.hpp"
+#include "nes.hpp"
+
+namespace nes {
+
+namespace {
+
+batch_result run_job(batch_job const& job) {
+    nintendo_entertainment_system nes{cartridge{job.rom}};
+    nes.disable_audio();
+
+    batch_result result;
+    result.frame_hashes.reserve(job.frames);
+    for (u32 frame = 0; frame < job.frames; ++frame) {
+        nes.set_controller_states((frame < job.input.size()) ? job.input[frame]
+                                                             : controller_states{});
+        nes.run_single_frame();
+        auto const* frame_buffer = reinterpret_cast<std::byte const*>(nes.frame_buffer());
+        result.frame_hashes.push_back(fnv1a({frame_buffer, 256 * 240}));
+    }
+
+    auto const ram = nes.ram();
+    result.ram.assign(ram.begin(), ram.end());
+    result.statistics = nes.statistics();
+    return result;
+}
+
+} // namespace
+
+vector<batch_result> run_batch(thread_pool& pool, std::span<batch_job const> jobs) {
+    vector<batch_result> results(jobs.size());
+    pool.parallel_for(jobs.size(), [&](std::size_t i) { results[i] = run_job(jobs[i]); });
+    return results;
+}
+
+} // namespace nes
@@ -0,0 +1,32 @@
+#ifndef NES_BATCH_RUNNER_HPP
+#define NES_BATCH_RUNNER_HPP
+
+#include "cartridge.hpp"
+#include "controller.hpp"
+#include "diagnostics/perf_counters.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+#include <memory>
+#include <span>
+
+namespace nes {
+
+struct batch_job {
+    std::shared_ptr<rom_image const> rom; // shared by all sessions
+    vector<controller_states> input{};    // per frame, no buttons pressed after the end
+    u32 frames{};
+};
+
+struct batch_result {
+    vector<u64> frame_hashes;   // fnv-1a of every frame buffer
+    vector<u8> ram;             // cpu ram after the last frame
+    perf_statistics statistics; // all zero unless built with NES_ENABLE_PERF_COUNTERS
+};
+
+// runs every job in its own emulator on the pool. results[i] belongs to jobs[i] and is written
+// only by the thread that ran the job.
+vector<batch_result> run_batch(thread_pool& pool, std::span<batch_job const> jobs);
+
+} // namespace nes
+
+#endif
@@ -1,30 +1,88 @@
 #ifndef NES_CARTRIDGE_HPP
 #define NES_CARTRIDGE_HPP
 
+#include "cow_array.hpp"
 #include "types.hpp"
 #include <cassert>
+#include <memory>
+#include <span>
 
 namespace nes {
 
 enum class mirroring : u8 { horizontal, vertical };
 
-// TODO: should the mapper be part of the cartridge?
-struct cartridge {
+// rom data of a game. immutable, so that all instances running the game share one copy.
+struct rom_image {
     vector<u8> prg_rom;
-    vector<u8> prg_ram;
-    vector<u8> chr_rom;
+    vector<u8> chr_rom; // empty if the cartridge has chr ram
     mirroring nametable_mirroring{};
+};
+
+// TODO: should the mapper be part of the cartridge?
+// the shared rom image and the ram of one instance. copies share the ram until it is written.
+class cartridge {
+  public:
+    explicit cartridge(std::shared_ptr<rom_image const> rom)
+        : rom_{std::move(rom)} {
+        if (rom_->chr_rom.empty()) {
+            chr_ram_.emplace();
+        }
+    }
 
-    [[nodiscard]] u8& operator[](u16 address) noexcept {
+    // cpu bus, 0x6000 - 0xffff
+    [[nodiscard]] u8 read(u16 address) const noexcept {
         assert(address >= 0x6000);
+
+        if (address < 0x8000) {
+            return prg_ram_[(address - 0x6000u) % prg_ram_.size()];
+        }
+        auto const& prg_rom = rom_->prg_rom;
         assert((prg_rom.size() % 0x4000) == 0);
+        return prg_rom[(address - 0x8000u) % prg_rom.size()];
+    }
+
+    void write(u16 address, u8 value) noexcept {
+        assert(address >= 0x6000);
 
+        // writes to rom have no effect without a mapper
         if (address < 0x8000) {
-            return prg_ram[(address - 0x6000u) % prg_ram.size()];
-        } else {
-            return prg_rom[(address - 0x8000u) % prg_rom.size()];
+            prg_ram_.set((address - 0x6000u) % prg_ram_.size(), value);
         }
     }
+
+    // ppu bus, 0x0000 - 0x1fff
+    [[nodiscard]] u8 read_chr(u16 address) const noexcept {
+        assert(address < 0x2000);
+        return chr_ram_ ? (*chr_ram_)[address] : rom_->chr_rom[address % rom_->chr_rom.size()];
+    }
+
+    void write_chr(u16 address, u8 value) noexcept {
+        assert(address < 0x2000);
+        if (chr_ram_) {
+            chr_ram_->set(address, value);
+        }
+    }
+
+    [[nodiscard]] mirroring nametable_mirroring() const noexcept {
+        return rom_->nametable_mirroring;
+    }
+
+    [[nodiscard]] std::shared_ptr<rom_image const> const& rom() const noexcept { return rom_; }
+
+    // for save states. chr ram is empty if the cartridge has chr rom.
+    [[nodiscard]] std::span<u8 const> prg_ram() const noexcept { return prg_ram_.view(); }
+    [[nodiscard]] std::span<u8> writable_prg_ram() { return prg_ram_.writable(); }
+    [[nodiscard]] std::span<u8 const> chr_ram() const noexcept {
+        return chr_ram_ ? chr_ram_->view() : std::span<u8 const>{};
+    }
+    [[nodiscard]] std::span<u8> writable_chr_ram() {
+        return chr_ram_ ? chr_ram_->writable() : std::span<u8>{};
+    }
+
+  private:
+    std::shared_ptr<rom_image const> rom_;
+    cow_array<u8, 0x2000> prg_ram_;
+    optional<cow_array<u8, 0x2000>> chr_ram_;
 };
 
 } // namespace nes
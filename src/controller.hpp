@@ -24,8 +24,8 @@ struct controller_state {
 };
 
 struct controller_states {
-    controller_state joy1;
-    controller_state joy2;
+    controller_state joy1{};
+    controller_state joy2{};
 };
 
 struct controller_port {
@@ -37,6 +37,8 @@ struct controller_port {
 
     // function that reads both controller ports
     callback_type read_controller;
+    // used instead if there is no callback
+    controller_states states{};
 
     u8 read(u16 address) noexcept {
         assert((address == 0x4016) || (address == 0x4017));
@@ -76,11 +78,7 @@ struct controller_port {
     }
 
     void update_shift_regs() noexcept {
-        if (!read_controller) {
-            return;
-        }
-
-        auto const [joy1, joy2] = read_controller();
+        auto const [joy1, joy2] = read_controller ? read_controller() : states;
         joy1_shift_reg = joy1;
         joy2_shift_reg = joy2;
     }
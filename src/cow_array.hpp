@@ -0,0 +1,82 @@
+#ifndef NES_COW_ARRAY_HPP
+#define NES_COW_ARRAY_HPP
+
+#include "types.hpp"
+#include <atomic>
+#include <memory>
+#include <span>
+#include <utility>
+
+namespace nes {
+
+// fixed size array that is shared by its copies until one of them is written (copy on write).
+// copying is a reference count increment, the first write after a copy copies the elements.
+// writes go through a cached pointer, so only the first write after a copy checks the sharing.
+// copying also clears the cache of the source, so one array must not be copied from several
+// threads at once.
+template <typename T, std::size_t N>
+class cow_array {
+  public:
+    cow_array() : elements_{std::make_shared<array<T, N>>()}, unique_{elements_->data()} {}
+
+    cow_array(cow_array const& other) : elements_{other.elements_} { other.unique_ = nullptr; }
+    cow_array(cow_array&& other) noexcept
+        : elements_{std::move(other.elements_)}, unique_{std::exchange(other.unique_, nullptr)} {}
+
+    cow_array& operator=(cow_array const& other) {
+        if (this != &other) {
+            elements_ = other.elements_;
+            unique_ = nullptr;
+            other.unique_ = nullptr;
+        }
+        return *this;
+    }
+    cow_array& operator=(cow_array&& other) noexcept {
+        elements_ = std::move(other.elements_);
+        unique_ = std::exchange(other.unique_, nullptr);
+        return *this;
+    }
+
+    ~cow_array() = default;
+
+    [[nodiscard]] T operator[](std::size_t i) const noexcept { return (*elements_)[i]; }
+
+    // throws std::bad_alloc if the first write after a copy cannot copy the elements
+    void set(std::size_t i, T value) { unique_data()[i] = value; }
+
+    [[nodiscard]] static constexpr std::size_t size() noexcept { return N; }
+
+    // the pointers are invalidated by the first write after a copy
+    [[nodiscard]] T const* data() const noexcept { return elements_->data(); }
+    [[nodiscard]] std::span<T const, N> view() const noexcept { return *elements_; }
+
+    // throws std::bad_alloc like set
+    [[nodiscard]] std::span<T, N> writable() { return std::span<T, N>{unique_data(), N}; }
+
+  private:
+    T* unique_data() {
+        if (unique_ == nullptr) [[unlikely]] {
+            unshare();
+        }
+        return unique_;
+    }
+
+    void unshare() {
+        if (elements_.use_count() != 1) {
+            elements_ = std::make_shared<array<T, N>>(*elements_);
+        } else {
+            // pairs with the release of the last other owner, whose reads must happen before
+            // our writes
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        unique_ = elements_->data();
+    }
+
+    std::shared_ptr<array<T, N>> elements_;
+    // the elements while no copy shares them, null after a copy until the next write
+    mutable T* unique_{nullptr};
+};
+
+} // namespace nes
+
+#endif
@@ -51,6 +51,7 @@ struct cpu_state {
     bool reset_pending{false};
     bool nmi_pending{false};
     bool irq_pending{false};
+    bool last_nmi{false}; // nmi is edge triggered
 
     u64 cycle_count{};
 };
@@ -0,0 +1,54 @@
+#include "disassembly.hpp"
+#include <cstdio>
+
+namespace nes {
+
+std::string disassemble(u16 address, u8 opcode, u8 low, u8 high) {
+    auto const name = instruction_names[opcode];
+    auto const space = name.find(' ');
+    if (space == std::string_view::npos) {
+        return std::string{name};
+    }
+
+    auto const mode = name.substr(space + 1);
+    u16 const absolute = static_cast<u16>((high << 8) | low);
+    char operand[16]{};
+
+    if (mode == "#") {
+        std::snprintf(operand, sizeof(operand), "#$%02X", low);
+    } else if (mode == "zpg") {
+        std::snprintf(operand, sizeof(operand), "$%02X", low);
+    } else if (mode == "zpg,X") {
+        std::snprintf(operand, sizeof(operand), "$%02X,X", low);
+    } else if (mode == "zpg,Y") {
+        std::snprintf(operand, sizeof(operand), "$%02X,Y", low);
+    } else if (mode == "X,ind") {
+        std::snprintf(operand, sizeof(operand), "($%02X,X)", low);
+    } else if (mode == "ind,Y") {
+        std::snprintf(operand, sizeof(operand), "($%02X),Y", low);
+    } else if (mode == "abs") {
+        std::snprintf(operand, sizeof(operand), "$%04X", absolute);
+    } else if (mode == "abs,X") {
+        std::snprintf(operand, sizeof(operand), "$%04X,X", absolute);
+    } else if (mode == "abs,Y") {
+        std::snprintf(operand, sizeof(operand), "$%04X,Y", absolute);
+    } else if (mode == "ind") {
+        std::snprintf(operand, sizeof(operand), "($%04X)", absolute);
+    } else if (mode == "rel") {
+        // branch target
+        std::snprintf(operand, sizeof(operand), "$%04X",
+                      static_cast<u16>(address + 2 + static_cast<i8>(low)));
+    } else if (mode == "A") {
+        operand[0] = 'A';
+    }
+    // impl has no operand
+
+    auto result = std::string{name.substr(0, space)};
+    if (operand[0] != '\0') {
+        result += ' ';
+        result += operand;
+    }
+    return result;
+}
+
+} // namespace nes
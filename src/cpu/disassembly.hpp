@@ -0,0 +1,65 @@
+#ifndef NES_CPU_DISASSEMBLY_HPP
+#define NES_CPU_DISASSEMBLY_HPP
+
+#include "../types.hpp"
+#include <string>
+#include <string_view>
+
+namespace nes {
+
+// mnemonic and addressing mode of every opcode, "---" for illegal opcodes
+constexpr array<std::string_view, 256> instruction_names = {{
+    "BRK impl", "ORA X,ind", "---",      "---", "---",       "ORA zpg",   "ASL zpg",   "---",
+    "PHP impl", "ORA #",     "ASL A",    "---", "---",       "ORA abs",   "ASL abs",   "---",
+    "BPL rel",  "ORA ind,Y", "---",      "---", "---",       "ORA zpg,X", "ASL zpg,X", "---",
+    "CLC impl", "ORA abs,Y", "---",      "---", "---",       "ORA abs,X", "ASL abs,X", "---",
+    "JSR abs",  "AND X,ind", "---",      "---", "BIT zpg",   "AND zpg",   "ROL zpg",   "---",
+    "PLP impl", "AND #",     "ROL A",    "---", "BIT abs",   "AND abs",   "ROL abs",   "---",
+    "BMI rel",  "AND ind,Y", "---",      "---", "---",       "AND zpg,X", "ROL zpg,X", "---",
+    "SEC impl", "AND abs,Y", "---",      "---", "---",       "AND abs,X", "ROL abs,X", "---",
+    "RTI impl", "EOR X,ind", "---",      "---", "---",       "EOR zpg",   "LSR zpg",   "---",
+    "PHA impl", "EOR #",     "LSR A",    "---", "JMP abs",   "EOR abs",   "LSR abs",   "---",
+    "BVC rel",  "EOR ind,Y", "---",      "---", "---",       "EOR zpg,X", "LSR zpg,X", "---",
+    "CLI impl", "EOR abs,Y", "---",      "---", "---",       "EOR abs,X", "LSR abs,X", "---",
+    "RTS impl", "ADC X,ind", "---",      "---", "---",       "ADC zpg",   "ROR zpg",   "---",
+    "PLA impl", "ADC #",     "ROR A",    "---", "JMP ind",   "ADC abs",   "ROR abs",   "---",
+    "BVS rel",  "ADC ind,Y", "---",      "---", "---",       "ADC zpg,X", "ROR zpg,X", "---",
+    "SEI impl", "ADC abs,Y", "---",      "---", "---",       "ADC abs,X", "ROR abs,X", "---",
+    "---",      "STA X,ind", "---",      "---", "STY zpg",   "STA zpg",   "STX zpg",   "---",
+    "DEY impl", "---",       "TXA impl", "---", "STY abs",   "STA abs",   "STX abs",   "---",
+    "BCC rel",  "STA ind,Y", "---",      "---", "STY zpg,X", "STA zpg,X", "STX zpg,Y", "---",
+    "TYA impl", "STA abs,Y", "TXS impl", "---", "---",       "STA abs,X", "---",       "---",
+    "LDY #",    "LDA X,ind", "LDX #",    "---", "LDY zpg",   "LDA zpg",   "LDX zpg",   "---",
+    "TAY impl", "LDA #",     "TAX impl", "---", "LDY abs",   "LDA abs",   "LDX abs",   "---",
+    "BCS rel",  "LDA ind,Y", "---",      "---", "LDY zpg,X", "LDA zpg,X", "LDX zpg,Y", "---",
+    "CLV impl", "LDA abs,Y", "TSX impl", "---", "LDY abs,X", "LDA abs,X", "LDX abs,Y", "---",
+    "CPY #",    "CMP X,ind", "---",      "---", "CPY zpg",   "CMP zpg",   "DEC zpg",   "---",
+    "INY impl", "CMP #",     "DEX impl", "---", "CPY abs",   "CMP abs",   "DEC abs",   "---",
+    "BNE rel",  "CMP ind,Y", "---",      "---", "---",       "CMP zpg,X", "DEC zpg,X", "---",
+    "CLD impl", "CMP abs,Y", "---",      "---", "---",       "CMP abs,X", "DEC abs,X", "---",
+    "CPX #",    "SBC X,ind", "---",      "---", "CPX zpg",   "SBC zpg",   "INC zpg",   "---",
+    "INX impl", "SBC #",     "NOP impl", "---", "CPX abs",   "SBC abs",   "INC abs",   "---",
+    "BEQ rel",  "SBC ind,Y", "---",      "---", "---",       "SBC zpg,X", "INC zpg,X", "---",
+    "SED impl", "SBC abs,Y", "---",      "---", "---",       "SBC abs,X", "INC abs,X", "---",
+}};
+
+// number of bytes (opcode and operands) of the instruction
+constexpr u8 instruction_length(u8 opcode) noexcept {
+    auto const name = instruction_names[opcode];
+    if ((name.size() < 4) || name.ends_with("impl") || name.ends_with(" A")) {
+        return 1;
+    }
+    if (name.ends_with("abs") || name.ends_with("abs,X") || name.ends_with("abs,Y") ||
+        name.ends_with(" ind")) {
+        return 3;
+    }
+    return 2;
+}
+
+// instruction at address with its operand formatted like the nestest log, e.g. "JMP $C5F5".
+// low and high are the bytes following the opcode (unused ones are ignored).
+std::string disassemble(u16 address, u8 opcode, u8 low, u8 high);
+
+} // namespace nes
+
+#endif
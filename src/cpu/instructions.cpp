@@ -436,11 +436,10 @@ instruction_state step(cpu_state& cpu, instruction_state state) noexcept {
     }
 
     // nmi handling, probably wrong
-    static bool last_nmi = false;
-    if (cpu.nmi && !last_nmi) {
+    if (cpu.nmi && !cpu.last_nmi) {
         cpu.nmi_pending = true;
     }
-    last_nmi = cpu.nmi;
+    cpu.last_nmi = cpu.nmi;
 
     // irq handling, probably wrong
     if (cpu.irq && !cpu.p.interrupt_disable) {
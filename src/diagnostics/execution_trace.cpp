@@ -0,0 +1,135 @@
+#include "execution_trace.hpp"
+#include "../cpu/disassembly.hpp"
+#include <cstdio>
+#include <istream>
+#include <ostream>
+#include <string>
+
+#if __has_include(<unistd.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#define NES_POSIX_FILE_IO
+#endif
+
+namespace nes {
+
+namespace {
+
+constexpr array<char, 8> file_magic{'N', 'E', 'S', 'T', 'R', 'A', 'C', 'E'};
+constexpr u32 file_version = 1;
+
+struct file_header {
+    array<char, 8> magic;
+    u32 version;
+    u32 record_size;
+    u64 record_count;
+};
+
+} // namespace
+
+std::pair<std::span<trace_record const>, std::span<trace_record const>>
+execution_trace::records() const noexcept {
+    std::span<trace_record const> const all{records_};
+    if (count_ <= records_.size()) {
+        return {all.first(static_cast<std::size_t>(count_)), {}};
+    }
+    auto const oldest = static_cast<std::size_t>(count_ & (records_.size() - 1));
+    return {all.subspan(oldest), all.first(oldest)};
+}
+
+void execution_trace::write(std::ostream& out) const {
+    auto const [older, newer] = records();
+    file_header const header{file_magic, file_version, sizeof(trace_record), size()};
+
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const*>(older.data()),
+              static_cast<std::streamsize>(older.size_bytes()));
+    out.write(reinterpret_cast<char const*>(newer.data()),
+              static_cast<std::streamsize>(newer.size_bytes()));
+}
+
+bool execution_trace::write_file(char const* path) const noexcept {
+#ifdef NES_POSIX_FILE_IO
+    auto const write_all = [](int file, void const* data, std::size_t size) {
+        auto const* bytes = static_cast<char const*>(data);
+        while (size > 0) {
+            auto const written = ::write(file, bytes, size);
+            if (written <= 0) {
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    };
+
+    int const file = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        return false;
+    }
+    auto const [older, newer] = records();
+    file_header const header{file_magic, file_version, sizeof(trace_record), size()};
+    bool const written = write_all(file, &header, sizeof(header)) &&
+                         write_all(file, older.data(), older.size_bytes()) &&
+                         write_all(file, newer.data(), newer.size_bytes());
+    return (::close(file) == 0) && written;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+optional<vector<trace_record>> read_execution_trace(std::istream& in) {
+    file_header header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        (header.magic != file_magic) || (header.version != file_version) ||
+        (header.record_size != sizeof(trace_record))) {
+        return std::nullopt;
+    }
+
+    vector<trace_record> records(static_cast<std::size_t>(header.record_count));
+    in.read(reinterpret_cast<char*>(records.data()),
+            static_cast<std::streamsize>(records.size() * sizeof(trace_record)));
+    records.resize(static_cast<std::size_t>(in.gcount()) / sizeof(trace_record));
+    return records;
+}
+
+void print_execution_trace(std::span<trace_record const> records, std::ostream& out) {
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        auto const& fetch = records[i];
+        if (!fetch.is_sync()) {
+            continue;
+        }
+
+        // the opcode is on the data bus of the fetch cycle, operands follow on the next reads
+        u8 const opcode = fetch.data;
+        u8 const length = instruction_length(opcode);
+        array<u8, 3> bytes{opcode, 0, 0};
+        u8 known_bytes = 1;
+        for (std::size_t j = i + 1; (j < records.size()) && (known_bytes < length); ++j) {
+            if (records[j].address != static_cast<u16>(fetch.address + known_bytes)) {
+                break;
+            }
+            bytes[known_bytes++] = records[j].data;
+        }
+
+        auto const instruction = (known_bytes < length)
+                                     ? std::string{instruction_names[opcode].substr(0, 3)}
+                                     : disassemble(fetch.address, bytes[0], bytes[1], bytes[2]);
+
+        char hex[12]{};
+        for (u8 b = 0; b < known_bytes; ++b) {
+            std::snprintf(hex + (3 * b), sizeof(hex) - (3 * b), "%02X ", bytes[b]);
+        }
+        hex[(3 * known_bytes) - 1] = '\0';
+
+        char line[128]{};
+        std::snprintf(line, sizeof(line),
+                      "%04X  %-8s  %-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+                      fetch.address, hex, instruction.c_str(), fetch.a, fetch.x, fetch.y, fetch.p,
+                      fetch.s, static_cast<unsigned long long>(fetch.cycle));
+        out << line;
+    }
+}
+
+} // namespace nes
@@ -0,0 +1,87 @@
+#ifndef NES_DIAGNOSTICS_EXECUTION_TRACE_HPP
+#define NES_DIAGNOSTICS_EXECUTION_TRACE_HPP
+
+#include "../cpu/cpu.hpp"
+#include "../types.hpp"
+#include <bit>
+#include <iosfwd>
+#include <span>
+
+namespace nes {
+
+// state of the cpu and its bus at the end of one cpu cycle
+struct trace_record {
+    enum flag : u8 { write = 0x01, sync = 0x02 };
+
+    u64 cycle;
+    u16 pc;
+    u16 address;
+    u8 data;
+    u8 flags;
+    u8 instruction_register;
+    u8 a;
+    u8 x;
+    u8 y;
+    u8 s;
+    u8 p;
+    [[maybe_unused]] u8 padding[4];
+
+    [[nodiscard]] constexpr bool is_write() const noexcept { return (flags & write) != 0; }
+    [[nodiscard]] constexpr bool is_sync() const noexcept { return (flags & sync) != 0; }
+};
+static_assert(sizeof(trace_record) == 24);
+
+// preallocated ring of the most recent cpu cycles. recording is a plain store, no formatting.
+class execution_trace {
+  public:
+    // capacity in cycles, rounded up to a power of two
+    explicit execution_trace(std::size_t capacity)
+        : records_(std::bit_ceil(std::max<std::size_t>(capacity, 1))) {}
+
+    void record(cpu_state const& cpu) noexcept {
+        auto& r = records_[count_ & (records_.size() - 1)];
+        r.cycle = cpu.cycle_count;
+        r.pc = cpu.pc;
+        r.address = cpu.address_bus;
+        r.data = cpu.data_bus;
+        r.flags = static_cast<u8>((cpu.rw == data_dir::write ? trace_record::write : 0) |
+                                  (cpu.sync ? trace_record::sync : 0));
+        r.instruction_register = cpu.instruction_register;
+        r.a = cpu.a;
+        r.x = cpu.x;
+        r.y = cpu.y;
+        r.s = cpu.s;
+        r.p = cpu.p;
+        ++count_;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return static_cast<std::size_t>(std::min<u64>(count_, records_.size()));
+    }
+
+    // retained records from oldest to newest, split in two parts where the ring wraps
+    [[nodiscard]] std::pair<std::span<trace_record const>, std::span<trace_record const>>
+    records() const noexcept;
+
+    // binary dump of the retained records, see read_execution_trace
+    void write(std::ostream& out) const;
+
+    // the same dump written with open/write/close only, so it can run in a signal handler.
+    // false when the file could not be written or the platform has no posix file api.
+    bool write_file(char const* path) const noexcept;
+
+  private:
+    vector<trace_record> records_;
+    u64 count_{0};
+};
+
+// reads a dump written by execution_trace::write. returns nullopt for unknown formats.
+optional<vector<trace_record>> read_execution_trace(std::istream& in);
+
+// one nestest style line per instruction:
+// C000  4C F5 C5  JMP $C5F5         A:00 X:00 Y:00 P:24 SP:FD CYC:7
+void print_execution_trace(std::span<trace_record const> records, std::ostream& out);
+
+} // namespace nes
+
+#endif
@@ -0,0 +1,111 @@
+#include "guest_profiler.hpp"
+#include "../cpu/disassembly.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <numeric>
+#include <ostream>
+#include <string>
+
+namespace nes {
+
+namespace {
+
+// mappers are not implemented yet, so banks are the 8kb windows of the cpu address space
+constexpr u32 bank_size = 0x2000;
+
+void write_line(std::ostream& out, char const* format, auto... arguments) {
+    char line[128]{};
+    std::snprintf(line, sizeof(line), format, arguments...);
+    out << line << '\n';
+}
+
+double percent(u64 part, u64 total) noexcept {
+    return (total == 0) ? 0.0 : (100.0 * static_cast<double>(part) / static_cast<double>(total));
+}
+
+} // namespace
+
+void guest_profiler::write_report(std::ostream& out, memory_reader const& read_memory,
+                                  std::size_t hot_spot_count) const {
+    u64 const total = std::accumulate(address_cycles_.begin(), address_cycles_.end(), u64{0});
+    write_line(out, "total cycles: %llu", static_cast<unsigned long long>(total));
+
+    // hot spots
+    vector<u32> addresses(address_cycles_.size());
+    std::iota(addresses.begin(), addresses.end(), 0u);
+    auto const hot_spots = std::min(hot_spot_count, addresses.size());
+    std::partial_sort(
+        addresses.begin(), addresses.begin() + hot_spots, addresses.end(),
+        [&](u32 lhs, u32 rhs) { return address_cycles_[lhs] > address_cycles_[rhs]; });
+
+    out << "\nhot spots:\n";
+    write_line(out, "%12s %7s  %-5s %s", "cycles", "share", "addr", "instruction");
+    for (std::size_t i = 0; (i < hot_spots) && (address_cycles_[addresses[i]] != 0); ++i) {
+        auto const address = static_cast<u16>(addresses[i]);
+        auto const instruction =
+            disassemble(address, read_memory(address), read_memory(static_cast<u16>(address + 1)),
+                        read_memory(static_cast<u16>(address + 2)));
+        write_line(out, "%12llu %6.2f%%  $%04X %s",
+                   static_cast<unsigned long long>(address_cycles_[address]),
+                   percent(address_cycles_[address], total), address, instruction.c_str());
+    }
+
+    out << "\nbanks:\n";
+    write_line(out, "%12s %7s  %s", "cycles", "share", "range");
+    for (u32 bank_start = 0; bank_start < address_cycles_.size(); bank_start += bank_size) {
+        auto const first = address_cycles_.begin() + bank_start;
+        u64 const cycles = std::accumulate(first, first + bank_size, u64{0});
+        if (cycles != 0) {
+            write_line(out, "%12llu %6.2f%%  $%04X-$%04X", static_cast<unsigned long long>(cycles),
+                       percent(cycles, total), bank_start, bank_start + bank_size - 1);
+        }
+    }
+
+    // opcodes
+    array<u8, 256> opcodes{};
+    std::iota(opcodes.begin(), opcodes.end(), u8{0});
+    std::sort(opcodes.begin(), opcodes.end(),
+              [&](u8 lhs, u8 rhs) { return opcode_cycles_[lhs] > opcode_cycles_[rhs]; });
+
+    out << "\nopcodes:\n";
+    write_line(out, "%12s %7s %12s %6s  %s", "cycles", "share", "executions", "cpi", "opcode");
+    for (auto const opcode : opcodes) {
+        if (opcode_cycles_[opcode] == 0) {
+            break;
+        }
+        auto const executions = std::max<u64>(opcode_executions_[opcode], 1);
+        write_line(out, "%12llu %6.2f%% %12llu %6.2f  $%02X %s",
+                   static_cast<unsigned long long>(opcode_cycles_[opcode]),
+                   percent(opcode_cycles_[opcode], total),
+                   static_cast<unsigned long long>(opcode_executions_[opcode]),
+                   static_cast<double>(opcode_cycles_[opcode]) / static_cast<double>(executions),
+                   opcode, std::string{instruction_names[opcode]}.c_str());
+    }
+
+    // addressing modes are the part of the instruction name after the mnemonic
+    std::map<std::string_view, std::pair<u64, u64>> modes; // cycles, executions
+    for (std::size_t opcode = 0; opcode < opcode_cycles_.size(); ++opcode) {
+        auto const name = instruction_names[opcode];
+        auto const space = name.find(' ');
+        auto const mode = (space == std::string_view::npos) ? name : name.substr(space + 1);
+        modes[mode].first += opcode_cycles_[opcode];
+        modes[mode].second += opcode_executions_[opcode];
+    }
+    vector<std::pair<std::string_view, std::pair<u64, u64>>> sorted_modes(modes.begin(),
+                                                                         modes.end());
+    std::sort(sorted_modes.begin(), sorted_modes.end(),
+              [](auto const& lhs, auto const& rhs) { return lhs.second.first > rhs.second.first; });
+
+    out << "\naddressing modes:\n";
+    write_line(out, "%12s %7s %12s  %s", "cycles", "share", "executions", "mode");
+    for (auto const& [mode, counts] : sorted_modes) {
+        if (counts.first != 0) {
+            write_line(out, "%12llu %6.2f%% %12llu  %s",
+                       static_cast<unsigned long long>(counts.first), percent(counts.first, total),
+                       static_cast<unsigned long long>(counts.second), std::string{mode}.c_str());
+        }
+    }
+}
+
+} // namespace nes
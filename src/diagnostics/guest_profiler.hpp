@@ -0,0 +1,58 @@
+#ifndef NES_DIAGNOSTICS_GUEST_PROFILER_HPP
+#define NES_DIAGNOSTICS_GUEST_PROFILER_HPP
+
+#include "../cpu/cpu.hpp"
+#include "../types.hpp"
+#include <functional>
+#include <iosfwd>
+
+namespace nes {
+
+// cycle counts of the emulated program per instruction address and per opcode
+class guest_profiler {
+  public:
+    using memory_reader = std::function<u8(u16)>;
+
+    // called at the end of every cpu cycle, when the data bus holds the value read
+    void record(cpu_state const& cpu) noexcept {
+        if (cpu.sync) {
+            instruction_address_ = cpu.address_bus;
+            opcode_ = cpu.data_bus;
+            ++opcode_executions_[opcode_];
+        }
+        // dma and interrupt cycles are charged to the instruction that was interrupted
+        ++address_cycles_[instruction_address_];
+        ++opcode_cycles_[opcode_];
+    }
+
+    // called instead of record for the cycles the cpu is halted for a dmc fetch
+    void record_stall() noexcept {
+        ++address_cycles_[instruction_address_];
+        ++opcode_cycles_[opcode_];
+    }
+
+    // cycles spent in the instruction at address, including the dma and interrupt cycles
+    [[nodiscard]] u64 address_cycles(u16 address) const noexcept {
+        return address_cycles_[address];
+    }
+    [[nodiscard]] u64 opcode_cycles(u8 opcode) const noexcept { return opcode_cycles_[opcode]; }
+    [[nodiscard]] u64 opcode_executions(u8 opcode) const noexcept {
+        return opcode_executions_[opcode];
+    }
+
+    // hot spots, 8kb banks, opcodes and addressing modes sorted by cycles.
+    // read_memory is used to disassemble the hot spots and must not have side effects.
+    void write_report(std::ostream& out, memory_reader const& read_memory,
+                      std::size_t hot_spot_count = 32) const;
+
+  private:
+    vector<u64> address_cycles_ = vector<u64>(0x10000);
+    array<u64, 256> opcode_cycles_{};
+    array<u64, 256> opcode_executions_{};
+    u16 instruction_address_{0};
+    u8 opcode_{0};
+};
+
+} // namespace nes
+
+#endif
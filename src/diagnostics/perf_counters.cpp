@@ -0,0 +1,19 @@
+#include "perf_counters.hpp"
+#include <ostream>
+
+namespace nes {
+
+void write_json(std::ostream& out, perf_statistics const& statistics) {
+    out << "{\"frames\":" << statistics.frames                               //
+        << ",\"cpu_cycles\":" << statistics.cpu_cycles                       //
+        << ",\"ppu_dots_rendered\":" << statistics.ppu_dots_rendered         //
+        << ",\"ppu_dots_skipped\":" << statistics.ppu_dots_skipped           //
+        << ",\"ppu_register_accesses\":" << statistics.ppu_register_accesses //
+        << ",\"dma_cycles\":" << statistics.dma_cycles                       //
+        << ",\"audio_samples\":" << statistics.audio_samples                 //
+        << ",\"cpu_time_ns\":" << statistics.cpu_time.count()                //
+        << ",\"ppu_time_ns\":" << statistics.ppu_time.count()                //
+        << ",\"apu_time_ns\":" << statistics.apu_time.count() << "}\n";
+}
+
+} // namespace nes
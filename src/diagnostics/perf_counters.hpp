@@ -0,0 +1,104 @@
+#ifndef NES_DIAGNOSTICS_PERF_COUNTERS_HPP
+#define NES_DIAGNOSTICS_PERF_COUNTERS_HPP
+
+#include "../types.hpp"
+#include <chrono>
+#include <iosfwd>
+
+namespace nes {
+
+#ifdef NES_ENABLE_PERF_COUNTERS
+constexpr bool perf_counters_enabled = true;
+#else
+constexpr bool perf_counters_enabled = false;
+#endif
+
+struct perf_statistics {
+    u64 frames{};
+    u64 cpu_cycles{};
+    u64 ppu_dots_rendered{}; // dots with background or sprite rendering enabled
+    u64 ppu_dots_skipped{};  // dots with rendering disabled
+    u64 ppu_register_accesses{};
+    u64 dma_cycles{};
+    u64 audio_samples{};
+
+    // estimated from every timing_interval-th cpu cycle
+    std::chrono::nanoseconds cpu_time{};
+    std::chrono::nanoseconds ppu_time{};
+    std::chrono::nanoseconds apu_time{};
+};
+
+// writes the statistics as a single line json object
+void write_json(std::ostream& out, perf_statistics const& statistics);
+
+template <bool Enabled>
+class perf_counters {
+  public:
+    // reading the clock every cycle would cost more than the emulation itself
+    static constexpr u64 timing_interval = 64;
+
+    using time_member = std::chrono::nanoseconds perf_statistics::*;
+
+    void count_cpu_cycle(bool dma_active) noexcept {
+        timing_this_cycle_ = (statistics_.cpu_cycles % timing_interval) == 0;
+        ++statistics_.cpu_cycles;
+        if (dma_active) {
+            ++statistics_.dma_cycles;
+        }
+    }
+    void count_ppu_dot(bool rendering) noexcept {
+        ++(rendering ? statistics_.ppu_dots_rendered : statistics_.ppu_dots_skipped);
+    }
+    void count_ppu_register_access() noexcept { ++statistics_.ppu_register_accesses; }
+    void count_audio_samples(std::size_t count) noexcept { statistics_.audio_samples += count; }
+    void count_frame() noexcept { ++statistics_.frames; }
+
+    template <typename Function>
+    void measure(time_member destination, Function&& function) noexcept {
+        if (!timing_this_cycle_) {
+            function();
+            return;
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        function();
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        statistics_.*destination +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) * timing_interval;
+    }
+
+    [[nodiscard]] perf_statistics const& statistics() const noexcept { return statistics_; }
+    void reset() noexcept { statistics_ = perf_statistics{}; }
+
+  private:
+    perf_statistics statistics_{};
+    bool timing_this_cycle_{};
+};
+
+// compiled out: every call is a no-op and the object is empty
+template <>
+class perf_counters<false> {
+  public:
+    using time_member = std::chrono::nanoseconds perf_statistics::*;
+
+    constexpr void count_cpu_cycle(bool) noexcept {}
+    constexpr void count_ppu_dot(bool) noexcept {}
+    constexpr void count_ppu_register_access() noexcept {}
+    constexpr void count_audio_samples(std::size_t) noexcept {}
+    constexpr void count_frame() noexcept {}
+
+    template <typename Function>
+    constexpr void measure(time_member, Function&& function) noexcept {
+        function();
+    }
+
+    [[nodiscard]] perf_statistics const& statistics() const noexcept {
+        static constexpr perf_statistics empty{};
+        return empty;
+    }
+    constexpr void reset() noexcept {}
+};
+
+} // namespace nes
+
+#endif
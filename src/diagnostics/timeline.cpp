@@ -0,0 +1,118 @@
+#include "timeline.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+namespace nes::timeline {
+
+namespace {
+
+enum class event_type : u8 { scope, counter };
+
+struct event {
+    char const* name;
+    clock::time_point begin;
+    clock::duration duration; // scope only
+    double value;             // counter only
+    event_type type;
+};
+
+// single producer (the owning thread), read by write_chrome_trace
+struct thread_buffer {
+    static constexpr std::size_t capacity = 1u << 17; // oldest events are overwritten
+
+    explicit thread_buffer(u32 id) : thread_id{id} {}
+
+    void push(event const& e) noexcept {
+        auto const index = count.load(std::memory_order_relaxed);
+        events[index % capacity] = e;
+        count.store(index + 1, std::memory_order_release);
+    }
+
+    u32 const thread_id;
+    std::atomic<u64> count{0};
+    vector<event> events = vector<event>(capacity);
+};
+
+struct registry {
+    std::atomic<bool> enabled{false};
+    clock::time_point epoch{clock::now()};
+
+    std::mutex mutex;
+    vector<std::shared_ptr<thread_buffer>> buffers; // keeps buffers alive after thread exit
+};
+
+registry& global_registry() noexcept {
+    static registry instance;
+    return instance;
+}
+
+thread_buffer& local_buffer() {
+    thread_local std::shared_ptr<thread_buffer> const buffer = [] {
+        auto& reg = global_registry();
+        std::scoped_lock lock{reg.mutex};
+        return reg.buffers.emplace_back(
+            std::make_shared<thread_buffer>(static_cast<u32>(reg.buffers.size() + 1)));
+    }();
+    return *buffer;
+}
+
+void write_escaped(std::ostream& out, char const* text) {
+    out << '"';
+    for (; *text != '\0'; ++text) {
+        if ((*text == '"') || (*text == '\\')) {
+            out << '\\';
+        }
+        out << *text;
+    }
+    out << '"';
+}
+
+} // namespace
+
+void enable(bool enabled) noexcept {
+    global_registry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool is_enabled() noexcept { return global_registry().enabled.load(std::memory_order_relaxed); }
+
+void record_scope(char const* name, clock::time_point begin, clock::time_point end) noexcept {
+    local_buffer().push({name, begin, end - begin, 0.0, event_type::scope});
+}
+
+void record_counter(char const* name, double value) noexcept {
+    local_buffer().push({name, clock::now(), {}, value, event_type::counter});
+}
+
+void write_chrome_trace(std::ostream& out) {
+    using microseconds = std::chrono::duration<double, std::micro>;
+
+    auto& reg = global_registry();
+    std::scoped_lock lock{reg.mutex};
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (auto const& buffer : reg.buffers) {
+        auto const count = buffer->count.load(std::memory_order_acquire);
+        auto const begin = (count > thread_buffer::capacity) ? (count - thread_buffer::capacity) : 0;
+
+        for (auto i = begin; i < count; ++i) {
+            auto const& e = buffer->events[i % thread_buffer::capacity];
+
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            write_escaped(out, e.name);
+            out << ",\"pid\":1,\"tid\":" << buffer->thread_id
+                << ",\"ts\":" << microseconds{e.begin - reg.epoch}.count();
+            if (e.type == event_type::scope) {
+                out << ",\"ph\":\"X\",\"dur\":" << microseconds{e.duration}.count() << "}";
+            } else {
+                out << ",\"ph\":\"C\",\"args\":{\"value\":" << e.value << "}}";
+            }
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+}
+
+} // namespace nes::timeline
@@ -0,0 +1,76 @@
+#ifndef NES_DIAGNOSTICS_TIMELINE_HPP
+#define NES_DIAGNOSTICS_TIMELINE_HPP
+
+#include "../types.hpp"
+#include <chrono>
+#include <iosfwd>
+
+namespace nes {
+
+#ifdef NES_ENABLE_TIMELINE
+constexpr bool timeline_enabled = true;
+#else
+constexpr bool timeline_enabled = false;
+#endif
+
+// scoped wall clock events in chrome trace event format (chrome://tracing, ui.perfetto.dev).
+// every thread records into its own preallocated ring buffer, so recording takes no locks.
+// only the first event of a thread registers its buffer under a mutex.
+namespace timeline {
+
+using clock = std::chrono::steady_clock;
+
+// recording is off until enabled at runtime, even when compiled in
+void enable(bool enabled = true) noexcept;
+[[nodiscard]] bool is_enabled() noexcept;
+
+// name must be a string literal (or otherwise outlive the timeline)
+void record_scope(char const* name, clock::time_point begin, clock::time_point end) noexcept;
+void record_counter(char const* name, double value) noexcept;
+
+// writes the events of all threads. recording threads should be idle while this runs.
+void write_chrome_trace(std::ostream& out);
+
+template <bool Enabled>
+class basic_scope {
+  public:
+    explicit basic_scope(char const* name) noexcept {
+        if (is_enabled()) {
+            name_ = name;
+            begin_ = clock::now();
+        }
+    }
+    ~basic_scope() noexcept {
+        if (name_ != nullptr) {
+            record_scope(name_, begin_, clock::now());
+        }
+    }
+    basic_scope(basic_scope const&) = delete;
+    basic_scope& operator=(basic_scope const&) = delete;
+
+  private:
+    char const* name_{nullptr};
+    clock::time_point begin_{};
+};
+
+template <>
+class basic_scope<false> {
+  public:
+    explicit constexpr basic_scope(char const*) noexcept {}
+};
+
+using scope = basic_scope<timeline_enabled>;
+
+inline void counter(char const* name, double value) noexcept {
+    if constexpr (timeline_enabled) {
+        if (is_enabled()) {
+            record_counter(name, value);
+        }
+    }
+}
+
+} // namespace timeline
+
+} // namespace nes
+
+#endif
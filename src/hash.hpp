@@ -0,0 +1,20 @@
+#ifndef NES_HASH_HPP
+#define NES_HASH_HPP
+
+#include "types.hpp"
+#include <span>
+
+namespace nes {
+
+// 64 bit fnv-1a, for comparing frames and states between runs
+constexpr u64 fnv1a(std::span<std::byte const> data, u64 hash = 0xcbf2'9ce4'8422'2325) noexcept {
+    for (auto const byte : data) {
+        hash ^= static_cast<u64>(byte);
+        hash *= 0x0000'0100'0000'01b3;
+    }
+    return hash;
+}
+
+} // namespace nes
+
+#endif
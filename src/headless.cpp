@@ -0,0 +1,134 @@
+#include "audio_capture.hpp"
+#include "hash.hpp"
+#include "ines.hpp"
+#include "movie.hpp"
+#include "movie_index.hpp"
+#include "segmented_replay.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace nes;
+
+namespace {
+
+struct options {
+    std::filesystem::path rom_file;
+    std::filesystem::path movie_file;
+    std::size_t threads{std::thread::hardware_concurrency()};
+    replay_config replay;
+    optional<std::filesystem::path> audio_file;
+};
+
+optional<options> parse_command_line(int argc, char** argv) {
+    options result;
+    vector<std::string_view> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const argument{argv[i]};
+        bool const has_value = (i + 1) < argc;
+
+        if ((argument == "--threads") && has_value) {
+            result.threads = std::stoul(argv[++i]);
+        } else if ((argument == "--segment-frames") && has_value) {
+            result.replay.segment_frames = static_cast<u32>(std::stoul(argv[++i]));
+        } else if ((argument == "--video") && has_value) {
+            result.replay.video_file = argv[++i];
+            result.replay.video_format = video_file_format_for(*result.replay.video_file);
+        } else if ((argument == "--audio") && has_value) {
+            result.audio_file = argv[++i];
+            result.replay.audio = true;
+        } else if (!argument.starts_with("--")) {
+            files.push_back(argument);
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (files.size() != 2) {
+        return std::nullopt;
+    }
+    result.rom_file = files[0];
+    result.movie_file = files[1];
+    return result;
+}
+
+} // namespace
+
+// replays a movie without a window on all cores, to verify it against its state hashes and to
+// export its video (256x240 rgba, y4m for files ending in .y4m and palette indices for .indices)
+// and audio (32 bit float, 44100 hz mono, wav for files ending in .wav and raw otherwise)
+int main(int argc, char** argv) {
+    auto const options = parse_command_line(argc, argv);
+    if (!options) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <rom file> <movie file> [--threads n] [--segment-frames n]"
+                     " [--video file] [--audio file]\n";
+        return EXIT_FAILURE;
+    }
+    // the segments write their frames at their own offsets, which a pipe cannot do
+    if (options->replay.video_file && !is_seekable_video_file(*options->replay.video_file)) {
+        std::cerr << "--video needs a regular file, " << *options->replay.video_file
+                  << " is not seekable (e.g. a pipe or stdout)\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream rom_input{options->rom_file, std::ios::binary};
+    auto const rom = read_rom(rom_input);
+    if (!rom) {
+        std::cerr << "Could not read " << options->rom_file << '\n';
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream movie_input{options->movie_file, std::ios::binary};
+    auto const m = read_movie(movie_input);
+    if (!m) {
+        std::cerr << "Could not read " << options->movie_file << '\n';
+        return EXIT_FAILURE;
+    }
+    if (m->rom_hash != hash_rom(*rom)) {
+        std::cerr << "Warning: the movie was recorded with a different ROM\n";
+    }
+
+    // keyframes of the movie index save the serial first pass
+    auto index_file = options->movie_file;
+    auto index = movie_index::open(index_file += ".idx", m->initial_state.size());
+
+    thread_pool pool{std::max<std::size_t>(options->threads, 1)};
+    auto const start = std::chrono::steady_clock::now();
+    auto const result = replay_segmented(pool, *m, rom, options->replay, index ? &*index : nullptr);
+    std::chrono::duration<double> const duration = std::chrono::steady_clock::now() - start;
+    if (!result) {
+        std::cerr << "The initial state of the movie does not fit the ROM\n";
+        return EXIT_FAILURE;
+    }
+
+    if (options->audio_file) {
+        std::ofstream audio{*options->audio_file, std::ios::binary};
+        audio_file_writer writer{
+            audio, audio_file_format_for(*options->audio_file),
+            static_cast<u32>(audio_processing_unit::default_sample_rate)};
+        writer.write(result->samples);
+        writer.finish();
+    }
+
+    auto const frames = result->frame_hashes.size();
+    std::cout << frames << " frames in " << result->segment_count << " segments on "
+              << pool.size() << " threads: " << duration.count() << " s, "
+              << (static_cast<double>(frames) / duration.count()) << " frames/s\n";
+    std::cout << "video hash: " << std::hex
+              << fnv1a(std::as_bytes(std::span{result->frame_hashes})) << std::dec << '\n';
+
+    if (result->first_desync) {
+        std::cout << "desync at frame " << *result->first_desync << '\n';
+        return EXIT_FAILURE;
+    }
+    if (!m->state_hashes.empty()) {
+        std::cout << "state hashes match\n";
+    }
+    return 0;
+}
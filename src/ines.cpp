@@ -0,0 +1,49 @@
+#include "ines.hpp"
+#include <algorithm>
+#include <istream>
+#include <string_view>
+
+namespace nes {
+
+std::optional<rom_header_info> read_header(array<u8, 16> const& header) noexcept {
+    constexpr std::string_view ines_format{"NES\x1a"};
+
+    if (!std::equal(begin(header), begin(header) + 4, begin(ines_format))) {
+        return {};
+    }
+
+    u16 const prg_rom_size = header[4] * 16 * 1024;
+    u16 const chr_rom_size = header[5] * 8 * 1024;
+    auto const mapper = static_cast<mapper_id>((header[6] >> 4) | (header[7] & 0xf0));
+    auto const nametable_mirroring = static_cast<mirroring>(header[6] & 0x01);
+
+    return rom_header_info{prg_rom_size, chr_rom_size, mapper, nametable_mirroring};
+}
+
+std::shared_ptr<rom_image const> read_rom(rom_header_info const& header_info, std::istream& rom) {
+    auto image = std::make_shared<rom_image>();
+    image->nametable_mirroring = header_info.nametable_mirroring;
+    image->prg_rom.resize(header_info.prg_rom_size);
+    rom.read(reinterpret_cast<char*>(image->prg_rom.data()), header_info.prg_rom_size);
+    image->chr_rom.resize(header_info.chr_rom_size);
+    rom.read(reinterpret_cast<char*>(image->chr_rom.data()), header_info.chr_rom_size);
+    return image;
+}
+
+std::shared_ptr<rom_image const> read_rom(std::istream& rom) {
+    array<u8, 16> header{};
+    rom.read(reinterpret_cast<char*>(header.data()), header.size());
+
+    auto const header_info = read_header(header);
+    if (!rom || !header_info || (header_info->mapper != mapper_id::nrom)) {
+        return nullptr;
+    }
+
+    auto image = read_rom(*header_info, rom);
+    if (!rom) {
+        return nullptr;
+    }
+    return image;
+}
+
+} // namespace nes
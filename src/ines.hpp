@@ -0,0 +1,31 @@
+#ifndef NES_INES_HPP
+#define NES_INES_HPP
+
+#include "cartridge.hpp"
+#include "types.hpp"
+#include <iosfwd>
+#include <memory>
+
+namespace nes {
+
+enum class mapper_id : u8 { nrom };
+
+struct rom_header_info {
+    u16 prg_rom_size{};
+    u16 chr_rom_size{};
+    mapper_id mapper{};
+    mirroring nametable_mirroring{};
+    // TODO PRG RAM
+};
+
+std::optional<rom_header_info> read_header(array<u8, 16> const& header) noexcept;
+
+// reads the rom data following the header
+std::shared_ptr<rom_image const> read_rom(rom_header_info const& header_info, std::istream& rom);
+
+// header and rom data, nullptr if the format or the mapper is not supported
+std::shared_ptr<rom_image const> read_rom(std::istream& rom);
+
+} // namespace nes
+
+#endif
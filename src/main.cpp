@@ -1,10 +1,24 @@
+#include "audio_capture.hpp"
+#include "ines.hpp"
+#include "movie.hpp"
+#include "movie_index.hpp"
 #include "nes.hpp"
+#include "palette.hpp"
+#include "rewind_buffer.hpp"
+#include "shared_memory_export.hpp"
+#include "spsc_ring.hpp"
+#include "video_capture.hpp"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <csignal>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <string>
 #include <thread>
 
 #include <spdlog/fmt/bin_to_hex.h>
@@ -15,84 +29,130 @@
 namespace fs = std::filesystem;
 using namespace nes;
 
-// TODO: load colors from .pal file
-constexpr array<SDL_Color, 64> nes_color_palette{{
-    {84, 84, 84, 255},    {0, 30, 116, 255},    {8, 16, 144, 255},    {48, 0, 136, 255},
-    {68, 0, 100, 255},    {92, 0, 48, 255},     {84, 4, 0, 255},      {60, 24, 0, 255},
-    {32, 42, 0, 255},     {8, 58, 0, 255},      {0, 64, 0, 255},      {0, 60, 0, 255},
-    {0, 50, 60, 255},     {0, 0, 0, 255},       {0, 0, 0, 255},       {0, 0, 0, 255}, //
-    {152, 150, 152, 255}, {8, 76, 196, 255},    {48, 50, 236, 255},   {92, 30, 228, 255},
-    {136, 20, 176, 255},  {160, 20, 100, 255},  {152, 34, 32, 255},   {120, 60, 0, 255},
-    {84, 90, 0, 255},     {40, 114, 0, 255},    {8, 124, 0, 255},     {0, 118, 40, 255},
-    {0, 102, 120, 255},   {0, 0, 0, 255},       {0, 0, 0, 255},       {0, 0, 0, 255}, //
-    {236, 238, 236, 255}, {76, 154, 236, 255},  {120, 124, 236, 255}, {176, 98, 236, 255},
-    {228, 84, 236, 255},  {236, 88, 180, 255},  {236, 106, 100, 255}, {212, 136, 32, 255},
-    {160, 170, 0, 255},   {116, 196, 0, 255},   {76, 208, 32, 255},   {56, 204, 108, 255},
-    {56, 180, 204, 255},  {60, 60, 60, 255},    {0, 0, 0, 255},       {0, 0, 0, 255}, //
-    {236, 238, 236, 255}, {168, 204, 236, 255}, {188, 188, 236, 255}, {212, 178, 236, 255},
-    {236, 174, 236, 255}, {236, 174, 212, 255}, {236, 180, 176, 255}, {228, 196, 144, 255},
-    {204, 210, 120, 255}, {180, 222, 120, 255}, {168, 226, 144, 255}, {152, 226, 180, 255},
-    {160, 214, 228, 255}, {160, 162, 160, 255}, {0, 0, 0, 255},       {0, 0, 0, 255},
-}};
-
-constexpr array<std::string_view, 256> instruction_names = {{
-    "BRK impl", "ORA X,ind", "---",      "---", "---",       "ORA zpg",   "ASL zpg",   "---",
-    "PHP impl", "ORA #",     "ASL A",    "---", "---",       "ORA abs",   "ASL abs",   "---",
-    "BPL rel",  "ORA ind,Y", "---",      "---", "---",       "ORA zpg,X", "ASL zpg,X", "---",
-    "CLC impl", "ORA abs,Y", "---",      "---", "---",       "ORA abs,X", "ASL abs,X", "---",
-    "JSR abs",  "AND X,ind", "---",      "---", "BIT zpg",   "AND zpg",   "ROL zpg",   "---",
-    "PLP impl", "AND #",     "ROL A",    "---", "BIT abs",   "AND abs",   "ROL abs",   "---",
-    "BMI rel",  "AND ind,Y", "---",      "---", "---",       "AND zpg,X", "ROL zpg,X", "---",
-    "SEC impl", "AND abs,Y", "---",      "---", "---",       "AND abs,X", "ROL abs,X", "---",
-    "RTI impl", "EOR X,ind", "---",      "---", "---",       "EOR zpg",   "LSR zpg",   "---",
-    "PHA impl", "EOR #",     "LSR A",    "---", "JMP abs",   "EOR abs",   "LSR abs",   "---",
-    "BVC rel",  "EOR ind,Y", "---",      "---", "---",       "EOR zpg,X", "LSR zpg,X", "---",
-    "CLI impl", "EOR abs,Y", "---",      "---", "---",       "EOR abs,X", "LSR abs,X", "---",
-    "RTS impl", "ADC X,ind", "---",      "---", "---",       "ADC zpg",   "ROR zpg",   "---",
-    "PLA impl", "ADC #",     "ROR A",    "---", "JMP ind",   "ADC abs",   "ROR abs",   "---",
-    "BVS rel",  "ADC ind,Y", "---",      "---", "---",       "ADC zpg,X", "ROR zpg,X", "---",
-    "SEI impl", "ADC abs,Y", "---",      "---", "---",       "ADC abs,X", "ROR abs,X", "---",
-    "---",      "STA X,ind", "---",      "---", "STY zpg",   "STA zpg",   "STX zpg",   "---",
-    "DEY impl", "---",       "TXA impl", "---", "STY abs",   "STA abs",   "STX abs",   "---",
-    "BCC rel",  "STA ind,Y", "---",      "---", "STY zpg,X", "STA zpg,X", "STX zpg,Y", "---",
-    "TYA impl", "STA abs,Y", "TXS impl", "---", "---",       "STA abs,X", "---",       "---",
-    "LDY #",    "LDA X,ind", "LDX #",    "---", "LDY zpg",   "LDA zpg",   "LDX zpg",   "---",
-    "TAY impl", "LDA #",     "TAX impl", "---", "LDY abs",   "LDA abs",   "LDX abs",   "---",
-    "BCS rel",  "LDA ind,Y", "---",      "---", "LDY zpg,X", "LDA zpg,X", "LDX zpg,Y", "---",
-    "CLV impl", "LDA abs,Y", "TSX impl", "---", "LDY abs,X", "LDA abs,X", "LDX abs,Y", "---",
-    "CPY #",    "CMP X,ind", "---",      "---", "CPY zpg",   "CMP zpg",   "DEC zpg",   "---",
-    "INY impl", "CMP #",     "DEX impl", "---", "CPY abs",   "CMP abs",   "DEC abs",   "---",
-    "BNE rel",  "CMP ind,Y", "---",      "---", "---",       "CMP zpg,X", "DEC zpg,X", "---",
-    "CLD impl", "CMP abs,Y", "---",      "---", "---",       "CMP abs,X", "DEC abs,X", "---",
-    "CPX #",    "SBC X,ind", "---",      "---", "CPX zpg",   "SBC zpg",   "INC zpg",   "---",
-    "INX impl", "SBC #",     "NOP impl", "---", "CPX abs",   "SBC abs",   "INC abs",   "---",
-    "BEQ rel",  "SBC ind,Y", "---",      "---", "---",       "SBC zpg,X", "INC zpg,X", "---",
-    "SED impl", "SBC abs,Y", "---",      "---", "---",       "SBC abs,X", "INC abs,X", "---",
-}};
-
-enum class mapper_id : u8 { nrom };
-
-struct rom_header_info {
-    u16 prg_rom_size{};
-    u16 chr_rom_size{};
-    mapper_id mapper{};
-    mirroring nametable_mirroring{};
-    // TODO PRG RAM
+constexpr auto nes_color_palette = [] {
+    array<SDL_Color, 64> result{};
+    std::ranges::transform(color_palette, result.begin(), [](rgb color) {
+        return SDL_Color{color.r, color.g, color.b, 255};
+    });
+    return result;
+}();
+
+struct options {
+    fs::path rom_file{"smb.nes"};
+    optional<fs::path> statistics_file;
+    u32 statistics_interval{1}; // frames per json record
+    optional<fs::path> timeline_file;
+    optional<fs::path> trace_file;
+    std::size_t trace_cycles{1u << 21};
+    optional<fs::path> profile_file;
+    std::size_t rewind_memory{32u << 20}; // bytes, 0 disables rewind
+    u32 run_ahead{0};                     // frames
+    optional<fs::path> record_file;
+    bool record_state_hashes{false};
+    optional<fs::path> play_file;
+    optional<u64> seek_frame; // playback starts at this frame
+    optional<fs::path> audio_capture_file; // .wav or raw float pcm at the device rate
+    optional<fs::path> video_capture_file; // .y4m or raw rgba, - for stdout
+    optional<std::string> shared_memory_name; // posix shared memory object, e.g. /nes0
 };
 
-std::optional<rom_header_info> read_header(array<u8, 16> const& header) {
-    constexpr std::string_view ines_format{"NES\x1a"};
+options parse_command_line(int argc, char** argv) {
+    options result;
+    bool rom_file_set = false;
 
-    if (!std::equal(begin(header), begin(header) + 4, begin(ines_format))) {
-        return {};
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const argument{argv[i]};
+
+        auto const next_value = [&]() -> std::string_view {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(fmt::format("Missing value for {}", argument));
+            }
+            return argv[++i];
+        };
+
+        if (argument == "--stats") {
+            result.statistics_file = fs::path{next_value()};
+        } else if (argument == "--stats-interval") {
+            result.statistics_interval = static_cast<u32>(std::stoul(std::string{next_value()}));
+            if (result.statistics_interval == 0) {
+                throw std::runtime_error("--stats-interval must be at least 1");
+            }
+        } else if (argument == "--trace") {
+            result.trace_file = fs::path{next_value()};
+        } else if (argument == "--trace-cycles") {
+            result.trace_cycles = std::stoull(std::string{next_value()});
+        } else if (argument == "--profile") {
+            result.profile_file = fs::path{next_value()};
+        } else if (argument == "--rewind-memory") {
+            result.rewind_memory = std::stoull(std::string{next_value()}) << 20;
+        } else if (argument == "--run-ahead") {
+            result.run_ahead = static_cast<u32>(std::stoul(std::string{next_value()}));
+        } else if (argument == "--record") {
+            result.record_file = fs::path{next_value()};
+        } else if (argument == "--record-hashes") {
+            result.record_state_hashes = true;
+        } else if (argument == "--play") {
+            result.play_file = fs::path{next_value()};
+        } else if (argument == "--seek") {
+            result.seek_frame = std::stoull(std::string{next_value()});
+        } else if (argument == "--capture-audio") {
+            result.audio_capture_file = fs::path{next_value()};
+        } else if (argument == "--capture-video") {
+            result.video_capture_file = fs::path{next_value()};
+        } else if (argument == "--export-shm") {
+            result.shared_memory_name = std::string{next_value()};
+        } else if (argument == "--timeline") {
+            result.timeline_file = fs::path{next_value()};
+        } else if (!argument.starts_with("--") && !rom_file_set) {
+            result.rom_file = argument;
+            rom_file_set = true;
+        } else {
+            throw std::runtime_error(fmt::format("Unknown argument {}", argument));
+        }
+    }
+
+    if (result.record_file && result.play_file) {
+        throw std::runtime_error("--record and --play cannot be combined");
+    }
+    if (result.seek_frame && !result.play_file) {
+        throw std::runtime_error("--seek needs --play");
+    }
+
+    return result;
+}
+
+// execution trace that is written when the emulator aborts (e.g. on an illegal opcode)
+struct {
+    nintendo_entertainment_system const* nes{nullptr};
+    std::string file; // kept as a string so the signal handler does not allocate
+} post_mortem_trace;
+
+void write_execution_trace() {
+    if (post_mortem_trace.nes == nullptr) {
+        return;
+    }
+    if (auto const* trace = post_mortem_trace.nes->get_execution_trace()) {
+        std::ofstream output{post_mortem_trace.file, std::ios::binary};
+        trace->write(output);
     }
+}
 
-    u16 const prg_rom_size = header[4] * 16 * 1024;
-    u16 const chr_rom_size = header[5] * 8 * 1024;
-    auto const mapper = static_cast<mapper_id>((header[6] >> 4) | (header[7] & 0xf0));
-    auto const nametable_mirroring = static_cast<mirroring>(header[6] & 0x01);
+// the samples the audio callback plays. the emulation waits for the callbacks instead of
+// polling the ring.
+struct audio_output {
+    spsc_ring<float> ring{16384}; // a few frames at any common rate
+    std::atomic<u64> callbacks{0};
+};
 
-    return rom_header_info{prg_rom_size, chr_rom_size, mapper, nametable_mirroring};
+// runs on the sdl audio thread: plays the samples of the ring, silence when it runs empty
+void SDLCALL audio_callback(void* userdata, Uint8* stream, int length) {
+    auto& output = *static_cast<audio_output*>(userdata);
+    std::span const samples{reinterpret_cast<float*>(stream),
+                            static_cast<std::size_t>(length) / sizeof(float)};
+    auto const count = output.ring.pop(samples);
+    std::fill(samples.begin() + static_cast<std::ptrdiff_t>(count), samples.end(), 0.0f);
+    output.callbacks.fetch_add(1, std::memory_order_release);
+    output.callbacks.notify_one();
 }
 
 // TODO button mapping etc.
@@ -147,13 +207,19 @@ int main(int argc, char** argv) {
 
         spdlog::set_pattern("%^%v%$");
 
-        fs::path rom_file{argc > 1 ? argv[1] : "smb.nes"};
+        auto const options = parse_command_line(argc, argv);
+        bool const video_to_stdout = options.video_capture_file == fs::path{"-"};
+        if (video_to_stdout) {
+            spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+            spdlog::set_pattern("%^%v%$");
+        }
+        auto const& rom_file = options.rom_file;
         spdlog::info("ROM: {}, file size: {} bytes", fs::absolute(rom_file).string(),
                      fs::file_size(rom_file));
 
         std::ifstream rom{rom_file, std::ios::binary};
         if (!rom) {
-            spdlog::critical("Could not open {}", argv[1]);
+            spdlog::critical("Could not open {}", rom_file.string());
             std::exit(EXIT_FAILURE);
         }
 
@@ -178,35 +244,201 @@ int main(int argc, char** argv) {
 
         game_controller controller_manager;
 
-        cartridge cart;
-        cart.nametable_mirroring = header_info->nametable_mirroring;
-        cart.prg_ram.resize(8192);
-        cart.prg_rom.resize(header_info->prg_rom_size);
-        rom.read(reinterpret_cast<char*>(cart.prg_rom.data()), header_info->prg_rom_size);
-        cart.chr_rom.resize(header_info->chr_rom_size);
-        rom.read(reinterpret_cast<char*>(cart.chr_rom.data()), header_info->chr_rom_size);
+        auto const rom_image = read_rom(*header_info, rom);
+        nintendo_entertainment_system nes{cartridge{rom_image}};
 
-        nintendo_entertainment_system nes{std::move(cart)};
-        nes.set_controller_callback([&] { return controller_manager.read_controllers(); });
+        std::ofstream statistics_output;
+        if (options.statistics_file) {
+            if (!perf_counters_enabled) {
+                spdlog::warn("Built without NES_ENABLE_PERF_COUNTERS, statistics will be empty");
+            }
+            statistics_output.open(*options.statistics_file);
+            if (!statistics_output) {
+                throw std::runtime_error(
+                    fmt::format("Could not open {}", options.statistics_file->string()));
+            }
+        }
+        u64 frame_count{0};
+
+        if (options.trace_file) {
+            nes.enable_execution_trace(options.trace_cycles);
+            post_mortem_trace = {&nes, options.trace_file->string()};
+            // only open/write/close in here, the dump is decoded offline by nes_trace_decoder
+            std::signal(SIGABRT, [](int) {
+                auto const* nes = post_mortem_trace.nes;
+                if (auto const* trace = nes ? nes->get_execution_trace() : nullptr) {
+                    (void)trace->write_file(post_mortem_trace.file.c_str());
+                }
+            });
+        }
+
+        if (options.profile_file) {
+            nes.enable_guest_profiler();
+        }
+
+        if (options.timeline_file) {
+            if (!timeline_enabled) {
+                spdlog::warn("Built without NES_ENABLE_TIMELINE, timeline will be empty");
+            }
+            timeline::enable();
+        }
+
+        // movies start from the power-on state and take over the input of every frame
+        optional<movie> recording;
+        if (options.record_file) {
+            recording.emplace(movie{.rom_hash = hash_rom(*rom_image)});
+            recording->initial_state.resize(nes.state_size());
+            nes.save_state(recording->initial_state);
+        }
+        optional<movie> playback;
+        if (options.play_file) {
+            std::ifstream movie_file{*options.play_file, std::ios::binary};
+            playback = read_movie(movie_file);
+            if (!playback) {
+                throw std::runtime_error(
+                    fmt::format("Could not read movie {}", options.play_file->string()));
+            }
+            if (playback->rom_hash != hash_rom(*rom_image)) {
+                spdlog::warn("The movie was recorded with a different ROM");
+            }
+            if (!nes.load_state(playback->initial_state)) {
+                throw std::runtime_error("The initial state of the movie does not fit the ROM");
+            }
+        }
+        bool const movie_active = recording || playback;
+
+        // keyframes for seeking are written to <movie>.idx while recording and on the first
+        // playback. seeking without them writes them first.
+        auto const index_path = [](fs::path movie_file) { return movie_file += ".idx"; };
+        optional<movie_index> index;
+        std::ofstream index_file;
+        optional<movie_index_writer> index_writer;
+        if (recording) {
+            index_file.open(index_path(*options.record_file), std::ios::binary);
+            index_writer.emplace(index_file, recording->initial_state);
+        }
+        if (playback) {
+            index = movie_index::open(index_path(*options.play_file), nes.state_size());
+            if (!index && options.seek_frame) {
+                spdlog::info("Writing keyframes of the movie");
+                {
+                    std::ofstream file{index_path(*options.play_file), std::ios::binary};
+                    write_movie_index(*playback, rom_image, file);
+                }
+                index = movie_index::open(index_path(*options.play_file), nes.state_size());
+            } else if (!index) {
+                index_file.open(index_path(*options.play_file), std::ios::binary);
+                index_writer.emplace(index_file, playback->initial_state);
+            }
+        }
+        std::size_t movie_frame{0};
+
+        if (options.seek_frame) {
+            auto const seek_start = std::chrono::steady_clock::now();
+            if (!seek(nes, *playback, index ? &*index : nullptr, *options.seek_frame)) {
+                throw std::runtime_error(
+                    fmt::format("The movie has only {} frames", playback->input.size()));
+            }
+            movie_frame = *options.seek_frame;
+            spdlog::info("Seek to frame {}: {} ms", movie_frame,
+                         std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - seek_start)
+                             .count());
+        }
+
+        // hold backspace to rewind. not while recording or playing a movie, which would no
+        // longer match the frames that were actually run.
+        optional<rewind_buffer> rewind;
+        vector<std::byte> rewind_state(nes.state_size());
+        if ((options.rewind_memory > 0) && !movie_active) {
+            rewind.emplace(rewind_state.size(), options.rewind_memory);
+        }
+
+        // run-ahead: the shown frame is run_ahead frames ahead of the emulated one, which hides
+        // the input lag of the game. the state after the real frame is restored afterwards.
+        vector<std::byte> run_ahead_state(options.run_ahead > 0 ? nes.state_size() : 0);
 
         // ************************************************************************************
 
+        // the audio callback reads the samples straight from the ring
+        audio_output audio;
+
         SDL_AudioSpec audio_desired{
-            .freq = audio_processing_unit::sample_rate,
+            .freq = static_cast<int>(audio_processing_unit::default_sample_rate),
             .format = AUDIO_F32SYS,
             .channels = 1,
             .samples = 512,
-            //.callback{audio_callback},
-            //.userdata{&apu},
+            .callback = audio_callback,
+            .userdata = &audio,
         };
         SDL_AudioSpec audio_obtained{};
-        auto audio_device = sdl::make_scoped(SDL_OpenAudioDevice(
-            nullptr, 0, &audio_desired, &audio_obtained, SDL_AUDIO_ALLOW_SAMPLES_CHANGE));
+        auto audio_device = sdl::make_scoped(
+            SDL_OpenAudioDevice(nullptr, 0, &audio_desired, &audio_obtained,
+                                SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE));
 
         spdlog::info(
             "Audio: Samplerate {} Hz, {} Channel(s), Buffersize: {} Samples, Format: 0x{:x}",
             audio_obtained.freq, audio_obtained.channels, audio_obtained.samples,
             audio_obtained.format);
+        if (!audio_synthesis_enabled) {
+            spdlog::warn("Built with NES_DISABLE_AUDIO, there will be no sound");
+        }
+
+        // the device runs at its native rate (e.g. 48 kHz), the apu resamples to it
+        auto const device_rate = static_cast<double>(audio_obtained.freq);
+        nes.set_sample_rate(device_rate);
+
+        // audio clocked sync: the emulation waits for the device to play the ring down to the
+        // target, and the sample rate is nudged by up to half a percent every frame so that the
+        // ring stays at the target without the pitch changing audibly or samples running out
+        auto const queue_target = 2 * (device_rate / 60.0);
+        constexpr double max_rate_deviation = 0.005;
+        auto const queued_samples = [&] { return static_cast<double>(audio.ring.size()); };
+
+        // what is played is recorded too. the rate nudging is not, it is inaudible.
+        std::ofstream audio_capture_output;
+        optional<audio_capture> audio_recorder;
+        if (options.audio_capture_file) {
+            audio_capture_output.open(*options.audio_capture_file, std::ios::binary);
+            if (!audio_capture_output) {
+                throw std::runtime_error(
+                    fmt::format("Could not open {}", options.audio_capture_file->string()));
+            }
+            audio_recorder.emplace(audio_capture_output,
+                                   audio_file_format_for(*options.audio_capture_file),
+                                   static_cast<u32>(audio_obtained.freq));
+        }
+
+        // every shown frame, e.g. into a pipe to an encoder
+        std::ofstream video_capture_output;
+        optional<video_capture> video_recorder;
+        if (video_to_stdout) {
+            video_recorder.emplace(std::cout, video_file_format::rgba);
+        } else if (options.video_capture_file) {
+            video_capture_output.open(*options.video_capture_file, std::ios::binary);
+            if (!video_capture_output) {
+                throw std::runtime_error(
+                    fmt::format("Could not open {}", options.video_capture_file->string()));
+            }
+            video_recorder.emplace(video_capture_output,
+                                   video_file_format_for(*options.video_capture_file));
+        }
+
+        // frame, audio and ram of every frame for other processes on this host
+        optional<shared_memory_export> shared_export =
+            options.shared_memory_name
+                ? shared_memory_export::create(*options.shared_memory_name, device_rate)
+                : std::nullopt;
+        if (options.shared_memory_name && !shared_export) {
+            throw std::runtime_error(
+                fmt::format("Could not create shared memory {}", *options.shared_memory_name));
+        }
+
+        {
+            // start with the ring at the target
+            vector<float> const silence(static_cast<std::size_t>(queue_target));
+            audio.ring.push(silence);
+        }
         SDL_PauseAudioDevice(audio_device.get(), 0);
 
         auto window = sdl::make_scoped(SDL_CreateWindow("NES Emulator", SDL_WINDOWPOS_CENTERED,
@@ -221,9 +453,9 @@ int main(int argc, char** argv) {
             return info.texture_formats[0];
         }();
 
-        // source image with color palette
+        // source image with color palette. sdl only reads the pixels.
         auto picture_surface = sdl::make_scoped(SDL_CreateRGBSurfaceWithFormatFrom(
-            nes.frame_buffer(), 256, 240, 8, 256, SDL_PIXELFORMAT_INDEX8));
+            const_cast<u8*>(nes.frame_buffer()), 256, 240, 8, 256, SDL_PIXELFORMAT_INDEX8));
         SDL_SetPaletteColors(picture_surface->format->palette, nes_color_palette.data(), 0,
                              static_cast<int>(nes_color_palette.size()));
 
@@ -234,42 +466,124 @@ int main(int argc, char** argv) {
             SDL_CreateTexture(renderer.get(), pixel_format, SDL_TEXTUREACCESS_STREAMING,
                               picture_surface->w, picture_surface->h));
 
-        {
-            // another hack: queue silence to give some space
-            std::array<float, 44100 / 15> silence{};
-            SDL_QueueAudio(audio_device.get(), silence.data(),
-                           static_cast<u32>(silence.size() * sizeof(float)));
-        }
+        // without audio synthesis the ring never fills, so the frames are paced by the clock
+        constexpr auto frame_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::duration<double>{1.0 / 60.0988});
+        auto next_frame = std::chrono::steady_clock::now();
+
+        bool quit = false;
+        while (!quit) {
+            timeline::scope const frame_scope{"frame"};
+
+            if (rewind) {
+                timeline::scope const rewind_scope{"rewind"};
+                if (SDL_GetKeyboardState(nullptr)[SDL_SCANCODE_BACKSPACE] != 0) {
+                    // the frame is run again to get its picture
+                    if (rewind->pop(rewind_state)) {
+                        nes.load_state(rewind_state);
+                    }
+                } else {
+                    nes.save_state(rewind_state);
+                    rewind->push(rewind_state);
+                }
+            }
 
-        using namespace std::chrono;
-        using namespace std::chrono_literals;
+            // the input is read once per frame and latched by the game on every controller
+            // strobe during the frame
+            auto const input = (playback && (movie_frame < playback->input.size()))
+                                   ? playback->input[movie_frame]
+                                   : controller_manager.read_controllers();
+            if (index_writer && (recording || (movie_frame < playback->input.size()))) {
+                index_writer->frame(nes, input);
+            }
+            nes.set_controller_states(input);
+            if (recording) {
+                recording->input.push_back(input);
+            }
 
-        auto start = steady_clock::now();
+            if (options.run_ahead == 0) {
+                nes.run_single_frame();
+            } else {
+                timeline::scope const run_ahead_scope{"run ahead"};
+
+                // only the audio of the real frame is used
+                nes.set_video_output(false);
+                nes.run_single_frame();
+                nes.save_state(run_ahead_state);
+
+                // only the picture of the last frame is used
+                nes.set_audio_output(false);
+                for (u32 i = 1; i <= options.run_ahead; ++i) {
+                    nes.set_video_output(i == options.run_ahead);
+                    nes.run_single_frame();
+                }
+                nes.set_audio_output(true);
 
-        while (true) {
-            nes.run_single_frame();
+                // the frame buffer is not part of the state and keeps the picture
+                nes.load_state(run_ahead_state);
+            }
+
+            if (movie_active) {
+                timeline::scope const movie_scope{"movie"};
+                if (recording && options.record_state_hashes) {
+                    recording->state_hashes.push_back(nes.state_hash());
+                }
+                if (playback && (movie_frame < playback->state_hashes.size()) &&
+                    (nes.state_hash() != playback->state_hashes[movie_frame])) {
+                    spdlog::warn("Movie desync at frame {}", movie_frame);
+                    playback->state_hashes.clear(); // report only the first desync
+                }
+                if (playback && ((movie_frame + 1) == playback->input.size())) {
+                    spdlog::info("Movie finished after {} frames", playback->input.size());
+                }
+                ++movie_frame;
+            }
 
             SDL_Event e;
             while (SDL_PollEvent(&e) == 1) {
                 if (e.type == SDL_QUIT) {
-                    return 0;
+                    quit = true;
                 }
             }
+            if (quit) {
+                break;
+            }
 
-            auto const samples = nes.sample_buffer();
+            {
+                timeline::scope const audio_scope{"queue audio"};
+                auto const samples = nes.sample_buffer();
+                auto const fill_error =
+                    std::clamp((queue_target - queued_samples()) / queue_target, -1.0, 1.0);
+                nes.set_sample_rate(device_rate * (1.0 + (fill_error * max_rate_deviation)));
+                audio.ring.push(samples);
+                if (audio_recorder) {
+                    audio_recorder->push(samples);
+                }
+                if (shared_export) {
+                    shared_export->publish(nes.frame_buffer(), samples, nes.ram());
+                }
+            }
 
-            // get number of samples still pending before enqueueing new samples
-            auto queued_samples = SDL_GetQueuedAudioSize(audio_device.get()) / sizeof(float);
+            if (video_recorder) {
+                video_recorder->push(nes.frame_buffer());
+            }
 
-            SDL_QueueAudio(audio_device.get(), samples.data(),
-                           static_cast<u32>(samples.size_bytes()));
+            if (statistics_output.is_open() &&
+                (++frame_count % options.statistics_interval) == 0) {
+                write_json(statistics_output, nes.statistics());
+                nes.reset_statistics();
+            }
 
-            // this converts the pixel format
-            sdl::checked(
-                SDL_BlitSurface(picture_surface.get(), nullptr, render_surface.get(), nullptr));
+            {
+                // this converts the pixel format
+                timeline::scope const blit_scope{"blit"};
+                sdl::checked(SDL_BlitSurface(picture_surface.get(), nullptr, render_surface.get(),
+                                             nullptr));
+            }
 
             {
                 // this just copies
+                timeline::scope const upload_scope{"texture upload"};
                 void* pixels{nullptr};
                 int pitch{};
 
@@ -281,19 +595,65 @@ int main(int argc, char** argv) {
             }
 
             sdl::checked(SDL_RenderCopy(renderer.get(), render_texture.get(), nullptr, nullptr));
-            SDL_RenderPresent(renderer.get());
+            {
+                timeline::scope const present_scope{"SDL_RenderPresent"};
+                SDL_RenderPresent(renderer.get());
+            }
 
-            // audio/video sync: try to always have 2 frames worth of samples in audio queue
-            // and adjust the video framerate accordingly
-            constexpr auto queue_target = 2 * (audio_processing_unit::sample_rate / 60.0);
-            auto delay_adjust = queued_samples / queue_target;
+            {
+                timeline::scope const sleep_scope{"wait for audio"};
+                if constexpr (audio_synthesis_enabled) {
+                    // every callback plays some samples, the ring is checked again after each one
+                    while (true) {
+                        auto const callbacks = audio.callbacks.load(std::memory_order_acquire);
+                        if (queued_samples() <= queue_target) {
+                            break;
+                        }
+                        audio.callbacks.wait(callbacks, std::memory_order_acquire);
+                    }
+                } else {
+                    // a frame that was late (e.g. while the window was moved) is not caught up
+                    next_frame = std::max(next_frame + frame_duration,
+                                          std::chrono::steady_clock::now());
+                    std::this_thread::sleep_until(next_frame);
+                }
+            }
+        }
 
-            auto const end = start + duration<double>{delay_adjust * samples.size() /
-                                                      audio_processing_unit::sample_rate};
+        write_execution_trace();
+        post_mortem_trace.nes = nullptr;
 
-            std::this_thread::sleep_until(end);
+        if (audio_recorder) {
+            if (audio_recorder->dropped_samples() > 0) {
+                spdlog::warn("The disk was too slow, {} audio samples were not captured",
+                             audio_recorder->dropped_samples());
+            }
+            audio_recorder.reset();
+            spdlog::info("Captured audio to {}", options.audio_capture_file->string());
+        }
+        if (video_recorder) {
+            if (video_recorder->dropped_frames() > 0) {
+                spdlog::warn("The video output was too slow, {} frames were not captured",
+                             video_recorder->dropped_frames());
+            }
+            video_recorder.reset();
+        }
+
+        if (recording) {
+            std::ofstream movie_file{*options.record_file, std::ios::binary};
+            write_movie(movie_file, *recording);
+            spdlog::info("Recorded {} frames to {}", recording->input.size(),
+                         options.record_file->string());
+        }
+
+        if (auto const* profiler = nes.get_guest_profiler()) {
+            std::ofstream profile_output{*options.profile_file};
+            profiler->write_report(profile_output, [&](u16 address) { return nes.peek(address); });
+        }
 
-            start = steady_clock::now();
+        if (options.timeline_file) {
+            std::ofstream timeline_output{*options.timeline_file};
+            timeline::write_chrome_trace(timeline_output);
         }
     } catch (std::exception const& e) {
         spdlog::critical("Error: {}", e.what());
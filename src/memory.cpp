@@ -18,13 +18,23 @@ u8 cpu_memory_map::read() const noexcept {
         // CPU Test Mode not implemented
         std::abort();
     } else {
-        return cartridge_[address_];
+        return cartridge_.read(address_);
+    }
+}
+
+u8 cpu_memory_map::peek(u16 address) const noexcept {
+    if (address < 0x2000) {
+        return ram_[address % 0x0800];
+    } else if (address < 0x6000) {
+        return 0;
+    } else {
+        return cartridge_.read(address);
     }
 }
 
 void cpu_memory_map::write(u8 value) noexcept {
     if (address_ < 0x2000) {
-        ram_[address_ % 0x0800] = value;
+        ram_.set(address_ % 0x0800, value);
     } else if (address_ < 0x4000) {
         ppu_.cpu_address_bus = address_;
         ppu_.cpu_data_bus = value;
@@ -40,7 +50,7 @@ void cpu_memory_map::write(u8 value) noexcept {
         // CPU Test Mode not implemented
         std::abort();
     } else {
-        cartridge_[address_] = value;
+        cartridge_.write(address_, value);
     }
 }
 
@@ -48,13 +58,13 @@ u8 ppu_memory_map::read(u16 address) const noexcept {
     assert(address < 0x4000); // 14 bit address space
 
     if (address < 0x2000) {
-        // pattern tables from chr-rom of cartridge
-        return cart.chr_rom[address];
+        // pattern tables from chr rom or chr ram of the cartridge
+        return cart.read_chr(address);
     } else {
         // nametables
         // ram with mirroring to fill 4kb
         // (0x3000 - 0x3fff are mirrors of 0x2000 - 0x2eff)
-        switch (cart.nametable_mirroring) {
+        switch (cart.nametable_mirroring()) {
             // TODO: make this part of cartridge?
         case mirroring::horizontal: address &= ~(0x0400); break;
         case mirroring::vertical: address &= ~(0x0800); break;
@@ -64,15 +74,19 @@ u8 ppu_memory_map::read(u16 address) const noexcept {
 }
 
 void ppu_memory_map::write(u16 address, u8 value) noexcept {
-    assert(address < 0x4000);  // 14 bit address space
-    assert(address >= 0x2000); // TODO: CHR RAM
-    assert(address < 0x3f00);  // writes to palette ram should not assert /WR
+    assert(address < 0x4000); // 14 bit address space
+    assert(address < 0x3f00); // writes to palette ram should not assert /WR
+
+    if (address < 0x2000) {
+        cart.write_chr(address, value);
+        return;
+    }
 
-    switch (cart.nametable_mirroring) {
+    switch (cart.nametable_mirroring()) {
     case mirroring::horizontal: address &= ~(0x0400); break;
     case mirroring::vertical: address &= ~(0x0800); break;
     }
-    vram[(address - 0x2000u) % vram.size()] = value;
+    vram.set((address - 0x2000u) % vram.size(), value);
 }
 
 } // namespace nes
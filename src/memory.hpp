@@ -4,13 +4,14 @@
 #include "apu/apu.hpp"
 #include "cartridge.hpp"
 #include "controller.hpp"
+#include "cow_array.hpp"
 #include "ppu.hpp"
 #include "types.hpp"
 
 namespace nes {
 
 struct cpu_memory_map {
-    vector<u8> ram_ = vector<u8>(2048);
+    cow_array<u8, 2048> ram_;
     picture_processing_unit& ppu_;
     cartridge& cartridge_;
     controller_port& controller_port_;
@@ -32,11 +33,14 @@ struct cpu_memory_map {
 
     u8 read() const noexcept;
 
+    // read without side effects for debugging. registers read as 0.
+    u8 peek(u16 address) const noexcept;
+
     void write(u8 value) noexcept;
 };
 
 struct ppu_memory_map {
-    vector<u8> vram = vector<u8>(2048);
+    cow_array<u8, 2048> vram{};
     cartridge& cart;
 
     u8 read(u16 address) const noexcept;
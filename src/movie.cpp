@@ -0,0 +1,126 @@
+#include "movie.hpp"
+#include "hash.hpp"
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+namespace nes {
+
+namespace {
+
+constexpr array<char, 8> file_magic{'N', 'E', 'S', 'M', 'O', 'V', 'I', 'E'};
+constexpr u32 file_version = 1;
+
+struct file_header {
+    enum flag : u32 { state_hashes = 0x01 };
+
+    array<char, 8> magic;
+    u32 version;
+    u32 flags;
+    u64 rom_hash;
+    u64 state_size;
+    u64 frame_count;
+};
+
+constexpr controller_state to_controller_state(u8 bits) noexcept {
+    return {.a = (bits & 0x01) != 0,
+            .b = (bits & 0x02) != 0,
+            .select = (bits & 0x04) != 0,
+            .start = (bits & 0x08) != 0,
+            .up = (bits & 0x10) != 0,
+            .down = (bits & 0x20) != 0,
+            .left = (bits & 0x40) != 0,
+            .right = (bits & 0x80) != 0};
+}
+
+template <typename T>
+bool read_array(std::istream& in, vector<T>& values) {
+    in.read(reinterpret_cast<char*>(values.data()),
+            static_cast<std::streamsize>(values.size() * sizeof(T)));
+    return static_cast<bool>(in);
+}
+
+// bytes from the read position to the end, nullopt if the stream cannot seek
+optional<u64> remaining_bytes(std::istream& in) {
+    auto const position = in.tellg();
+    if (position == std::istream::pos_type(-1) || !in.seekg(0, std::ios::end)) {
+        return std::nullopt;
+    }
+    auto const end = in.tellg();
+    in.seekg(position);
+    if (end == std::istream::pos_type(-1) || !in) {
+        return std::nullopt;
+    }
+    return static_cast<u64>(end - position);
+}
+
+} // namespace
+
+u64 hash_rom(rom_image const& rom) noexcept {
+    auto const hash = fnv1a(std::as_bytes(std::span{rom.prg_rom}));
+    return fnv1a(std::as_bytes(std::span{rom.chr_rom}), hash);
+}
+
+void write_movie(std::ostream& out, movie const& m) {
+    bool const has_hashes = !m.state_hashes.empty();
+    file_header const header{file_magic,
+                             file_version,
+                             has_hashes ? file_header::state_hashes : 0u,
+                             m.rom_hash,
+                             m.initial_state.size(),
+                             m.input.size()};
+
+    vector<array<u8, 2>> input(m.input.size());
+    std::ranges::transform(m.input, input.begin(), [](controller_states states) {
+        return array<u8, 2>{states.joy1, states.joy2};
+    });
+
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const*>(m.initial_state.data()),
+              static_cast<std::streamsize>(m.initial_state.size()));
+    out.write(reinterpret_cast<char const*>(input.data()),
+              static_cast<std::streamsize>(input.size() * sizeof(input[0])));
+    if (has_hashes) {
+        out.write(reinterpret_cast<char const*>(m.state_hashes.data()),
+                  static_cast<std::streamsize>(m.state_hashes.size() * sizeof(u64)));
+    }
+}
+
+optional<movie> read_movie(std::istream& in) {
+    file_header header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        (header.magic != file_magic) || (header.version != file_version)) {
+        return std::nullopt;
+    }
+
+    // the sizes are checked against the file before anything is allocated for them
+    auto const remaining = remaining_bytes(in);
+    u64 const frame_size = sizeof(array<u8, 2>) +
+                           (((header.flags & file_header::state_hashes) != 0) ? sizeof(u64) : 0);
+    if (!remaining || (header.state_size > *remaining) ||
+        (header.frame_count > ((*remaining - header.state_size) / frame_size))) {
+        return std::nullopt;
+    }
+
+    movie m{.rom_hash = header.rom_hash};
+    m.initial_state.resize(static_cast<std::size_t>(header.state_size));
+    vector<array<u8, 2>> input(static_cast<std::size_t>(header.frame_count));
+    if (!read_array(in, m.initial_state) || !read_array(in, input)) {
+        return std::nullopt;
+    }
+
+    m.input.reserve(input.size());
+    for (auto const [joy1, joy2] : input) {
+        m.input.push_back({to_controller_state(joy1), to_controller_state(joy2)});
+    }
+
+    if ((header.flags & file_header::state_hashes) != 0) {
+        m.state_hashes.resize(input.size());
+        if (!read_array(in, m.state_hashes)) {
+            return std::nullopt;
+        }
+    }
+    return m;
+}
+
+} // namespace nes
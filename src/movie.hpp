@@ -0,0 +1,30 @@
+#ifndef NES_MOVIE_HPP
+#define NES_MOVIE_HPP
+
+#include "cartridge.hpp"
+#include "controller.hpp"
+#include "types.hpp"
+#include <iosfwd>
+
+namespace nes {
+
+// recorded input of a game session. the input of a frame is what the game latches on every
+// controller strobe during that frame, so replaying it from the initial state is deterministic.
+struct movie {
+    u64 rom_hash{};
+    vector<std::byte> initial_state{}; // save state the movie starts from, usually power-on
+    vector<controller_states> input{}; // one per frame
+    vector<u64> state_hashes{};        // state_hash() after each frame, may be empty
+};
+
+[[nodiscard]] u64 hash_rom(rom_image const& rom) noexcept;
+
+// binary file: header, initial state, 2 bytes of input per frame and optional state hashes
+void write_movie(std::ostream& out, movie const& m);
+
+// returns nullopt for unknown formats, truncated files and streams that cannot seek
+optional<movie> read_movie(std::istream& in);
+
+} // namespace nes
+
+#endif
@@ -0,0 +1,154 @@
+#include "movie_index.hpp"
+#include "hash.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace nes {
+
+namespace {
+
+constexpr array<char, 8> file_magic{'N', 'E', 'S', 'I', 'N', 'D', 'E', 'X'};
+constexpr u32 file_version = 1;
+
+struct file_header {
+    array<char, 8> magic;
+    u32 version;
+    u32 interval;
+    u64 state_size;
+    u64 stride; // bytes per keyframe: input hash, state, padding to 8 bytes
+};
+
+u64 hash_input(controller_states input, u64 hash) noexcept {
+    array<std::byte, 2> const bytes{std::byte{u8{input.joy1}}, std::byte{u8{input.joy2}}};
+    return fnv1a(bytes, hash);
+}
+
+constexpr std::size_t keyframe_stride(std::size_t state_size) noexcept {
+    return (sizeof(u64) + state_size + 7) & ~std::size_t{7};
+}
+
+} // namespace
+
+u64 hash_movie(movie const& m, std::size_t frames) noexcept {
+    auto hash = fnv1a(m.initial_state);
+    for (auto const input : std::span{m.input}.first(frames)) {
+        hash = hash_input(input, hash);
+    }
+    return hash;
+}
+
+movie_index_writer::movie_index_writer(std::ostream& out,
+                                       std::span<std::byte const> initial_state, u32 interval)
+    : out_{out}, interval_{std::max<u32>(interval, 1)},
+      stride_{keyframe_stride(initial_state.size())}, movie_hash_{fnv1a(initial_state)},
+      record_(stride_) {
+    file_header const header{file_magic, file_version, interval_, initial_state.size(), stride_};
+    out_.write(reinterpret_cast<char const*>(&header), sizeof(header));
+}
+
+void movie_index_writer::frame(nintendo_entertainment_system const& nes,
+                               controller_states input) {
+    if ((frame_ % interval_) == 0) {
+        std::memcpy(record_.data(), &movie_hash_, sizeof(movie_hash_));
+        nes.save_state(std::span{record_}.subspan(sizeof(movie_hash_)));
+        out_.write(reinterpret_cast<char const*>(record_.data()),
+                   static_cast<std::streamsize>(record_.size()));
+    }
+    movie_hash_ = hash_input(input, movie_hash_);
+    ++frame_;
+}
+
+optional<movie_index> movie_index::open(std::filesystem::path const& file,
+                                        std::size_t state_size) {
+    std::ifstream in{file, std::ios::binary | std::ios::ate};
+    auto const file_size = static_cast<std::size_t>(std::max<std::streamoff>(in.tellg(), 0));
+
+    file_header header{};
+    if (!in.seekg(0) || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        (header.magic != file_magic) || (header.version != file_version) ||
+        (header.interval == 0) || (header.state_size != state_size) ||
+        (header.stride != keyframe_stride(state_size))) {
+        return std::nullopt;
+    }
+
+    // a partly written last keyframe is ignored
+    auto const size = (file_size - sizeof(header)) / header.stride;
+    return movie_index{std::move(in), header.interval, header.stride, size};
+}
+
+movie_index::movie_index(std::ifstream&& file, u32 interval, std::size_t stride,
+                         std::size_t size)
+    : file_{std::move(file)}, interval_{interval}, stride_{stride}, size_{size},
+      record_(stride) {}
+
+bool movie_index::load(std::size_t k, u64 movie_hash, nintendo_entertainment_system& nes) {
+    if (k >= size_) {
+        return false;
+    }
+
+    file_.clear();
+    auto const offset = static_cast<std::streamoff>(sizeof(file_header) + (k * stride_));
+    if (!file_.seekg(offset) || !file_.read(reinterpret_cast<char*>(record_.data()),
+                                            static_cast<std::streamsize>(record_.size()))) {
+        return false;
+    }
+
+    u64 keyframe_movie_hash{};
+    std::memcpy(&keyframe_movie_hash, record_.data(), sizeof(keyframe_movie_hash));
+    return (keyframe_movie_hash == movie_hash) &&
+           nes.load_state(std::span{record_}.subspan(sizeof(u64)));
+}
+
+void write_movie_index(movie const& m, std::shared_ptr<rom_image const> const& rom,
+                       std::ostream& out, u32 interval) {
+    nintendo_entertainment_system nes{cartridge{rom}};
+    if (!nes.load_state(m.initial_state)) {
+        return;
+    }
+    nes.set_video_output(false);
+    nes.set_audio_output(false);
+
+    movie_index_writer writer{out, m.initial_state, interval};
+    for (auto const input : m.input) {
+        writer.frame(nes, input);
+        nes.set_controller_states(input);
+        nes.run_single_frame();
+    }
+}
+
+bool seek(nintendo_entertainment_system& nes, movie const& m, movie_index* index, u64 frame) {
+    if (frame > m.input.size()) {
+        return false;
+    }
+
+    // at least one frame is run to get its picture
+    u64 start = 0;
+    bool loaded = false;
+    if ((index != nullptr) && (frame > 0)) {
+        auto const interval = index->interval();
+        auto k = std::min<std::size_t>(((frame - 1) / interval) + 1, index->size());
+        while (!loaded && (k-- > 0)) {
+            start = k * interval;
+            loaded = index->load(k, hash_movie(m, start), nes);
+        }
+    }
+    if (!loaded) {
+        start = 0;
+        if (!nes.load_state(m.initial_state)) {
+            return false;
+        }
+    }
+
+    nes.set_video_output(false);
+    nes.set_audio_output(false);
+    for (auto f = start; f < frame; ++f) {
+        nes.set_video_output((f + 1) == frame);
+        nes.set_controller_states(m.input[f]);
+        nes.run_single_frame();
+    }
+    nes.set_video_output(true);
+    nes.set_audio_output(true);
+    return true;
+}
+
+} // namespace nes
@@ -0,0 +1,75 @@
+#ifndef NES_MOVIE_INDEX_HPP
+#define NES_MOVIE_INDEX_HPP
+
+#include "movie.hpp"
+#include "nes.hpp"
+#include "types.hpp"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+
+namespace nes {
+
+// keyframes of a movie for seeking: the full state before every interval-th frame.
+// the side file stores them with a fixed stride after the header, so a keyframe is read (or
+// memory mapped) at its offset without touching the rest of the file. every keyframe carries
+// the hash of the movie up to it and is only used if the movie matches, so the index of an
+// edited or re-recorded movie is never applied.
+
+constexpr u32 default_keyframe_interval = 30;
+
+// hash of the initial state and the input of the first frames of the movie
+[[nodiscard]] u64 hash_movie(movie const& m, std::size_t frames) noexcept;
+
+// writes the keyframes while a movie is recorded or played
+class movie_index_writer {
+  public:
+    movie_index_writer(std::ostream& out, std::span<std::byte const> initial_state,
+                       u32 interval = default_keyframe_interval);
+
+    // call before every frame of the movie with the state before the frame and its input
+    void frame(nintendo_entertainment_system const& nes, controller_states input);
+
+  private:
+    std::ostream& out_;
+    u32 interval_;
+    std::size_t stride_;
+    u64 frame_{0};
+    u64 movie_hash_;
+    vector<std::byte> record_;
+};
+
+class movie_index {
+  public:
+    // nullopt if the file is missing or is not an index of states of this size
+    static optional<movie_index> open(std::filesystem::path const& file, std::size_t state_size);
+
+    [[nodiscard]] u32 interval() const noexcept { return interval_; }
+    [[nodiscard]] std::size_t size() const noexcept { return size_; } // keyframes
+
+    // loads keyframe k into nes if the movie up to it has the given hash_movie
+    bool load(std::size_t k, u64 movie_hash, nintendo_entertainment_system& nes);
+
+  private:
+    movie_index(std::ifstream&& file, u32 interval, std::size_t stride, std::size_t size);
+
+    std::ifstream file_;
+    u32 interval_;
+    std::size_t stride_;
+    std::size_t size_;
+    vector<std::byte> record_;
+};
+
+// plays the whole movie with output disabled to write its index
+void write_movie_index(movie const& m, std::shared_ptr<rom_image const> const& rom,
+                       std::ostream& out, u32 interval = default_keyframe_interval);
+
+// runs nes to the state before the given frame of the movie, starting from the closest
+// matching keyframe before it (or the start of the movie). the frame buffer shows the frame
+// before. output is enabled afterwards. returns false if the movie has fewer frames.
+bool seek(nintendo_entertainment_system& nes, movie const& m, movie_index* index, u64 frame);
+
+} // namespace nes
+
+#endif
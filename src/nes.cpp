@@ -1,49 +1,214 @@
 #include "nes.hpp"
+#include "hash.hpp"
 
 namespace nes {
+
+namespace {
+
+struct state_header {
+    array<char, 4> magic{'N', 'E', 'S', 'S'};
+    u32 version{save_state_version};
+    u64 size{};
+};
+
+// cpu cycles a dmc sample fetch takes from the cpu. 1 to 4 on the hardware depending on what
+// the cpu is doing, the common case is taken.
+constexpr u8 dmc_dma_cycles = 4;
+
+} // namespace
+
+nintendo_entertainment_system::nintendo_entertainment_system(
+    nintendo_entertainment_system const& parent)
+    : cpu_{parent.cpu_}, state_{parent.state_}, oam_dma_{parent.oam_dma_},
+      dmc_stall_cycles_{parent.dmc_stall_cycles_}, ppu_{parent.ppu_},
+      video_memory_{.vram = parent.video_memory_.vram, .cart = cartridge_},
+      controller_{parent.controller_}, apu_{parent.apu_}, cartridge_{parent.cartridge_},
+      counters_{parent.counters_} {
+    memory_.ram_ = parent.memory_.ram_;
+    memory_.address_ = parent.memory_.address_;
+}
+
+std::unique_ptr<nintendo_entertainment_system> nintendo_entertainment_system::fork() const {
+    return std::unique_ptr<nintendo_entertainment_system>{
+        new nintendo_entertainment_system{*this}};
+}
+
 void nintendo_entertainment_system::run_single_frame() noexcept {
-    while (!ppu_.has_frame_buffer()) {
-        run_cpu_cycle();
+    timeline::scope const frame_scope{"run_single_frame"};
+
+    bool frame_complete = false;
+    while (!frame_complete) {
+        // cpu cycles are batched per scanline so that tracing them stays affordable
+        timeline::scope const scanline_scope{"scanline"};
+
+        auto const scanline = ppu_.scanline();
+        while (!frame_complete && (ppu_.scanline() == scanline)) {
+            run_cpu_cycle();
+            frame_complete = ppu_.has_frame_buffer();
+        }
     }
+    // counted where they are produced, also in frames whose samples are never fetched
+    auto const samples = apu_.end_frame();
+    counters_.count_audio_samples(samples);
+    timeline::counter("audio samples", static_cast<double>(samples));
+    counters_.count_frame();
 }
 
 void nintendo_entertainment_system::run_cpu_cycle() noexcept {
-    if (oam_dma_) {
-        oam_dma_ = step(cpu_, *oam_dma_);
-    } else {
-        state_ = step(cpu_, state_);
-    }
+    counters_.count_cpu_cycle(oam_dma_.has_value() || (dmc_stall_cycles_ > 0));
 
-    memory_.set_address(cpu_.address_bus);
+    // the cpu and the oam dma halt while the dmc has the bus, the rest of the system runs on
+    bool const stalled = dmc_stall_cycles_ > 0;
+    if (stalled) {
+        --dmc_stall_cycles_;
+        ++cpu_.cycle_count; // the cycle still counts, e.g. for the oam dma alignment
+        if (guest_profiler_) {
+            guest_profiler_->record_stall();
+        }
+    }
 
-    if (cpu_.rw == data_dir::write) {
-        if (cpu_.address_bus == 0x4014) {
-            oam_dma_ = oam_dma_state(cpu_.data_bus, (cpu_.cycle_count % 2 == 0));
+    counters_.measure(&perf_statistics::cpu_time, [&] {
+        if (stalled) {
+            return;
+        }
+        if (oam_dma_) {
+            oam_dma_ = step(cpu_, *oam_dma_);
         } else {
-            memory_.write(cpu_.data_bus);
+            state_ = step(cpu_, state_);
         }
-    }
 
-    for (u8 i = 0; i < 3; i++) {
-        ppu_.step();
+        memory_.set_address(cpu_.address_bus);
 
-        if (ppu_.video_memory_access) {
-            if (*ppu_.video_memory_access == data_dir::read) {
-                ppu_.video_data_bus = video_memory_.read(ppu_.video_address_bus);
+        if (cpu_.rw == data_dir::write) {
+            if (cpu_.address_bus == 0x4014) {
+                oam_dma_ = oam_dma_state(cpu_.data_bus, (cpu_.cycle_count % 2 == 0));
             } else {
-                video_memory_.write(ppu_.video_address_bus, ppu_.video_data_bus);
+                memory_.write(cpu_.data_bus);
             }
         }
+    });
+
+    if (ppu_.cpu_register_access) {
+        counters_.count_ppu_register_access();
     }
 
+    counters_.measure(&perf_statistics::ppu_time, [&] {
+        for (u8 i = 0; i < 3; i++) {
+            counters_.count_ppu_dot(ppu_.rendering_enabled());
+            ppu_.step();
+
+            if (ppu_.video_memory_access) {
+                if (*ppu_.video_memory_access == data_dir::read) {
+                    ppu_.video_data_bus = video_memory_.read(ppu_.video_address_bus);
+                } else {
+                    video_memory_.write(ppu_.video_address_bus, ppu_.video_data_bus);
+                }
+            }
+        }
+    });
+
     cpu_.nmi = ppu_.nmi;
 
-    if (cpu_.rw == data_dir::read) {
-        cpu_.data_bus = memory_.read();
+    if (!stalled) {
+        counters_.measure(&perf_statistics::cpu_time, [&] {
+            if (cpu_.rw == data_dir::read) {
+                cpu_.data_bus = memory_.read();
+            }
+        });
+
+        if (execution_trace_) {
+            execution_trace_->record(cpu_);
+        }
+        if (guest_profiler_) {
+            guest_profiler_->record(cpu_);
+        }
     }
 
-    apu_.step();
+    counters_.measure(&perf_statistics::apu_time, [&] {
+        if (apu_.step()) {
+            // samples are always in cartridge space, which reads without side effects
+            apu_.complete_dma(memory_.peek(apu_.dma_address()));
+            dmc_stall_cycles_ += dmc_dma_cycles;
+        }
+    });
     cpu_.irq = apu_.interrupt();
 }
 
+std::size_t nintendo_entertainment_system::state_size() const noexcept {
+    state_writer counter;
+    counter.write(state_header{});
+    write_state(counter);
+    return counter.size();
+}
+
+std::size_t
+nintendo_entertainment_system::save_state(std::span<std::byte> destination) const noexcept {
+    auto const size = state_size();
+    if (destination.size() < size) {
+        return 0;
+    }
+
+    state_writer writer{destination};
+    writer.write(state_header{.size = size});
+    write_state(writer);
+    return size;
+}
+
+bool nintendo_entertainment_system::load_state(std::span<std::byte const> source) noexcept {
+    state_reader reader{source};
+    auto const header = reader.read<state_header>();
+    if ((header.magic != state_header{}.magic) || (header.version != save_state_version) ||
+        (header.size != state_size()) || (source.size() < header.size)) {
+        return false;
+    }
+
+    read_state(reader);
+    return true;
+}
+
+u64 nintendo_entertainment_system::state_hash() const noexcept {
+    array<u8, 7> const registers{static_cast<u8>(cpu_.pc & 0xff), static_cast<u8>(cpu_.pc >> 8),
+                                 cpu_.a, cpu_.x, cpu_.y, cpu_.s, cpu_.p};
+    auto hash = fnv1a(std::as_bytes(std::span{registers}));
+    hash = fnv1a(std::as_bytes(std::span{&cpu_.cycle_count, 1}), hash);
+    hash = fnv1a(std::as_bytes(memory_.ram_.view()), hash);
+    hash = fnv1a(std::as_bytes(video_memory_.vram.view()), hash);
+    hash = fnv1a(std::as_bytes(cartridge_.prg_ram()), hash);
+    return fnv1a(std::as_bytes(cartridge_.chr_ram()), hash);
+}
+
+void nintendo_entertainment_system::write_state(state_writer& writer) const noexcept {
+    writer.write(cpu_);
+    writer.write(state_);
+    writer.write(oam_dma_);
+    writer.write(dmc_stall_cycles_);
+    ppu_.save_state(writer);
+    apu_.save_state(writer);
+    writer.write(controller_.controller_port_latch);
+    writer.write(controller_.joy1_shift_reg);
+    writer.write(controller_.joy2_shift_reg);
+    writer.write(memory_.address_);
+    writer.write_bytes(std::as_bytes(memory_.ram_.view()));
+    writer.write_bytes(std::as_bytes(video_memory_.vram.view()));
+    writer.write_bytes(std::as_bytes(cartridge_.prg_ram()));
+    writer.write_bytes(std::as_bytes(cartridge_.chr_ram()));
+}
+
+void nintendo_entertainment_system::read_state(state_reader& reader) noexcept {
+    reader.read(cpu_);
+    reader.read(state_);
+    reader.read(oam_dma_);
+    reader.read(dmc_stall_cycles_);
+    ppu_.load_state(reader);
+    apu_.load_state(reader);
+    reader.read(controller_.controller_port_latch);
+    reader.read(controller_.joy1_shift_reg);
+    reader.read(controller_.joy2_shift_reg);
+    reader.read(memory_.address_);
+    reader.read_bytes(std::as_writable_bytes(memory_.ram_.writable()));
+    reader.read_bytes(std::as_writable_bytes(video_memory_.vram.writable()));
+    reader.read_bytes(std::as_writable_bytes(cartridge_.writable_prg_ram()));
+    reader.read_bytes(std::as_writable_bytes(cartridge_.writable_chr_ram()));
+}
+
 } // namespace nes
@@ -5,37 +5,116 @@
 #include "controller.hpp"
 #include "cpu/cpu.hpp"
 #include "cpu/instructions.hpp"
+#include "diagnostics/execution_trace.hpp"
+#include "diagnostics/guest_profiler.hpp"
+#include "diagnostics/perf_counters.hpp"
+#include "diagnostics/timeline.hpp"
 #include "memory.hpp"
 #include "oam_dma.hpp"
 #include "ppu.hpp"
+#include "save_state.hpp"
+#include <memory>
+#include <span>
 
 namespace nes {
 
 class nintendo_entertainment_system {
   public:
-    explicit nintendo_entertainment_system(cartridge&& cart) : cartridge_{cart} {}
+    explicit nintendo_entertainment_system(cartridge&& cart) : cartridge_{std::move(cart)} {}
 
     void run_single_frame() noexcept;
 
+    // copy of the running system for branching from the current state (e.g. tree search).
+    // ram, vram, prg/chr ram, the frame buffer and the sample buffer are shared with this system
+    // until either side writes them, so forking is cheap. diagnostics are not copied.
+    // forking marks the memory of this system as shared, so one system must not be forked from
+    // several threads at once. the first write after a fork terminates if the copy fails.
+    [[nodiscard]] std::unique_ptr<nintendo_entertainment_system> fork() const;
+
     auto frame_buffer() noexcept {
         // TODO span? but i only ever need a pointer, size is constant
         return ppu_.get_frame_buffer();
     }
 
-    // TODO: audio callback?
-
     auto sample_buffer() noexcept { return apu_.get_sample_buffer(); }
 
+    // audio samples per second, between frames. defaults to 44100 Hz.
+    void set_sample_rate(double sample_rate) noexcept { apu_.set_sample_rate(sample_rate); }
+
+    // for instances that never play audio (e.g. agents). the cpu visible apu state stays exact,
+    // no samples are produced and no sample memory is used. the state layout is the same.
+    // audio cannot be enabled when built with NES_DISABLE_AUDIO.
+    void enable_audio() { apu_.enable_audio(); }
+    void disable_audio() noexcept { apu_.disable_audio(); }
+
+    // every channel on its own besides the mix, for audio analysis
+    void enable_audio_stems() { apu_.enable_stems(); }
+    void disable_audio_stems() noexcept { apu_.disable_stems(); }
+    auto stem_buffer(audio_channel channel) noexcept { return apu_.get_stem_buffer(channel); }
+
+    // frames that are neither shown nor heard (e.g. run-ahead) can skip rendering and mixing
+    void set_video_output(bool enabled) noexcept { ppu_.output_enabled = enabled; }
+    void set_audio_output(bool enabled) noexcept { apu_.set_output_enabled(enabled); }
+
     void set_controller_callback(controller_port::callback_type&& callback) {
         controller_.read_controller = callback;
     }
 
+    // latched by the game when there is no controller callback
+    void set_controller_states(controller_states states) noexcept { controller_.states = states; }
+
+    // all zero unless built with NES_ENABLE_PERF_COUNTERS
+    [[nodiscard]] perf_statistics const& statistics() const noexcept {
+        return counters_.statistics();
+    }
+    void reset_statistics() noexcept { counters_.reset(); }
+
+    // keeps the cpu and bus state of the most recent cpu cycles
+    void enable_execution_trace(std::size_t cycles) {
+        execution_trace_ = std::make_unique<execution_trace>(cycles);
+    }
+    void disable_execution_trace() noexcept { execution_trace_.reset(); }
+    [[nodiscard]] execution_trace const* get_execution_trace() const noexcept {
+        return execution_trace_.get();
+    }
+
+    // cycle counts per instruction address and opcode of the running program
+    void enable_guest_profiler() { guest_profiler_ = std::make_unique<guest_profiler>(); }
+    void disable_guest_profiler() noexcept { guest_profiler_.reset(); }
+    [[nodiscard]] guest_profiler const* get_guest_profiler() const noexcept {
+        return guest_profiler_.get();
+    }
+
+    [[nodiscard]] std::span<u8 const> ram() const noexcept { return memory_.ram_.view(); }
+
+    // cpu memory read without side effects, for debugging
+    [[nodiscard]] u8 peek(u16 address) const noexcept { return memory_.peek(address); }
+
+    // snapshot of the whole system except for the frame buffer and the audio samples.
+    // the size is constant for a cartridge, so the buffer can be allocated once.
+    [[nodiscard]] std::size_t state_size() const noexcept;
+    // returns the number of bytes written or 0 if the destination is too small
+    std::size_t save_state(std::span<std::byte> destination) const noexcept;
+    // returns false and leaves the system untouched if the state does not fit this system
+    bool load_state(std::span<std::byte const> source) noexcept;
+
+    // hash of the cpu registers, the cycle count and all ram, where a desync shows up within a
+    // few frames. unlike the save state it has no padding bytes, so equal systems hash equal.
+    [[nodiscard]] u64 state_hash() const noexcept;
+
   private:
+    // only for fork, the memory maps refer to the other members
+    nintendo_entertainment_system(nintendo_entertainment_system const& parent);
+
     void run_cpu_cycle() noexcept;
 
+    void write_state(state_writer& writer) const noexcept;
+    void read_state(state_reader& reader) noexcept;
+
     cpu_state cpu_{.reset_pending = true};
     instruction_state state_{fetching_address{}};
     optional<oam_dma_state> oam_dma_;
+    u8 dmc_stall_cycles_{0}; // the cpu waits for a dmc sample fetch
 
     picture_processing_unit ppu_;
     ppu_memory_map video_memory_{.cart = cartridge_};
@@ -47,6 +126,10 @@ class nintendo_entertainment_system {
     cpu_memory_map memory_{ppu_, cartridge_, controller_, apu_};
 
     cartridge cartridge_;
+
+    [[no_unique_address]] perf_counters<perf_counters_enabled> counters_;
+    std::unique_ptr<execution_trace> execution_trace_;
+    std::unique_ptr<guest_profiler> guest_profiler_;
 };
 
 } // namespace nes
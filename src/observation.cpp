@@ -0,0 +1,122 @@
+#include "observation.hpp"
+#include "palette.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace nes {
+
+namespace {
+
+constexpr std::size_t frame_width = 256;
+constexpr std::size_t frame_height = 240;
+
+template <std::size_t Channels, typename Convert>
+constexpr array<array<u8, Channels>, 64> make_colors(Convert convert) noexcept {
+    array<array<u8, Channels>, 64> result{};
+    for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] = convert(i);
+    }
+    return result;
+}
+
+constexpr auto greyscale_colors =
+    make_colors<1>([](std::size_t i) { return array<u8, 1>{greyscale_palette[i]}; });
+constexpr auto rgb_colors = make_colors<3>([](std::size_t i) {
+    auto const [r, g, b] = color_palette[i];
+    return array<u8, 3>{r, g, b};
+});
+
+// sums every column over the rows of the boxes first, then the columns of every box
+template <std::size_t Channels>
+void average_boxes(u8 const* frame, array<array<u8, Channels>, 64> const& colors_of,
+                   std::span<u16 const> column_begin, u16 row_begin, u16 row_end,
+                   u8* output) noexcept {
+    array<u16, frame_width * Channels> column_sums{}; // at most 240 rows of 255
+    array<u8, frame_width * Channels> colors{};
+    for (auto y = row_begin; y < row_end; ++y) {
+        // the lookup is a gather, the sum is vectorized
+        auto const* line = frame + (y * frame_width);
+        for (std::size_t x = 0; x < frame_width; ++x) {
+            auto const& color = colors_of[line[x] & 0x3f];
+            for (std::size_t channel = 0; channel < Channels; ++channel) {
+                colors[(x * Channels) + channel] = color[channel];
+            }
+        }
+        for (std::size_t i = 0; i < column_sums.size(); ++i) {
+            column_sums[i] += colors[i];
+        }
+    }
+
+    auto const rows = static_cast<float>(row_end - row_begin);
+    for (std::size_t box = 0; box + 1 < column_begin.size(); ++box) {
+        array<u32, Channels> sums{};
+        for (auto x = column_begin[box]; x < column_begin[box + 1]; ++x) {
+            for (std::size_t channel = 0; channel < Channels; ++channel) {
+                sums[channel] += column_sums[(x * Channels) + channel];
+            }
+        }
+
+        // a float reciprocal instead of an integer division per output byte
+        auto const columns = static_cast<float>(column_begin[box + 1] - column_begin[box]);
+        float const scale = 1.0f / (columns * rows);
+        for (std::size_t channel = 0; channel < Channels; ++channel) {
+            *output++ = static_cast<u8>((static_cast<float>(sums[channel]) * scale) + 0.5f);
+        }
+    }
+}
+
+} // namespace
+
+observation_encoder::observation_encoder(observation_format format)
+    : format_{format}, column_begin_(std::clamp<std::size_t>(format.width, 1, frame_width) + 1),
+      row_begin_(std::clamp<std::size_t>(format.height, 1, frame_height) + 1) {
+    format_.width = static_cast<u16>(column_begin_.size() - 1);
+    format_.height = static_cast<u16>(row_begin_.size() - 1);
+
+    for (std::size_t i = 0; i < column_begin_.size(); ++i) {
+        column_begin_[i] = static_cast<u16>(i * frame_width / format_.width);
+    }
+    for (std::size_t i = 0; i < row_begin_.size(); ++i) {
+        row_begin_[i] = static_cast<u16>(i * frame_height / format_.height);
+    }
+}
+
+void observation_encoder::encode(u8 const* frame, std::span<u8> output) const noexcept {
+    assert(output.size() == format_.size());
+
+    auto* out = output.data();
+    for (std::size_t row = 0; row < format_.height; ++row) {
+        switch (format_.color) {
+        case color_mode::palette: {
+            auto const* line = frame + (row_begin_[row] * frame_width);
+            for (std::size_t column = 0; column < format_.width; ++column) {
+                *out++ = line[column_begin_[column]];
+            }
+        } break;
+        case color_mode::greyscale: {
+            average_boxes(frame, greyscale_colors, column_begin_, row_begin_[row],
+                          row_begin_[row + 1], out);
+            out += format_.width;
+        } break;
+        case color_mode::rgb: {
+            average_boxes(frame, rgb_colors, column_begin_, row_begin_[row], row_begin_[row + 1],
+                          out);
+            out += format_.width * 3;
+        } break;
+        }
+    }
+}
+
+void max_pool(std::span<u8> observation, std::span<u8> previous) noexcept {
+    assert(observation.size() == previous.size());
+
+    auto* current = observation.data();
+    auto* last = previous.data();
+    for (std::size_t i = 0; i < observation.size(); ++i) {
+        auto const value = current[i];
+        current[i] = std::max(value, last[i]);
+        last[i] = value;
+    }
+}
+
+} // namespace nes
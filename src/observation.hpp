@@ -0,0 +1,50 @@
+#ifndef NES_OBSERVATION_HPP
+#define NES_OBSERVATION_HPP
+
+#include "types.hpp"
+#include <span>
+
+namespace nes {
+
+enum class color_mode : u8 {
+    palette,   // palette indices, sampled from the top left pixel of every box
+    greyscale, // average luma of every box
+    rgb,       // average color of every box, three bytes per pixel
+};
+
+struct observation_format {
+    u16 width{256};
+    u16 height{240};
+    color_mode color{color_mode::palette};
+    bool max_pool{false}; // element-wise maximum of the last two frames
+
+    [[nodiscard]] constexpr std::size_t size() const noexcept {
+        return std::size_t{width} * height * (color == color_mode::rgb ? 3 : 1);
+    }
+};
+
+// converts and downsamples the 256x240 frame buffer in a single pass, for agents that work on
+// small greyscale frames. the box boundaries are computed once.
+class observation_encoder {
+  public:
+    // width and height are clamped to 1..256 and 1..240
+    explicit observation_encoder(observation_format format);
+
+    [[nodiscard]] observation_format const& format() const noexcept { return format_; }
+
+    // frame points to 256x240 palette indices, output must have format().size() bytes
+    void encode(u8 const* frame, std::span<u8> output) const noexcept;
+
+  private:
+    observation_format format_;
+    vector<u16> column_begin_; // width + 1 entries
+    vector<u16> row_begin_;    // height + 1 entries
+};
+
+// observation = max(observation, previous), previous = the unpooled observation.
+// a plain loop over bytes, which compilers turn into packed maximum instructions.
+void max_pool(std::span<u8> observation, std::span<u8> previous) noexcept;
+
+} // namespace nes
+
+#endif
@@ -181,6 +181,12 @@ void picture_processing_unit::render_pixel() noexcept {
         return;
     }
 
+    if (!output_enabled) {
+        // nothing else depends on the pixel value, so it is not needed
+        current_pixel = (current_pixel + 1) % (256 * 240);
+        return;
+    }
+
     u8 palette_number = 0;
     u8 pixel_value = 0;
     bool sprite_select = false;
@@ -221,7 +227,7 @@ void picture_processing_unit::render_pixel() noexcept {
         (sprite_select ? 0x10 : 0x00) | ((palette_number << 2) & 0x0c) | (pixel_value & 0x03);
 
     u8 const pixel_color = palette_ram[palette_address];
-    frame_buffer[current_pixel++] = pixel_color;
+    frame_buffer.set(current_pixel++, pixel_color);
     if (current_pixel >= (256 * 240)) {
         current_pixel = 0;
     }
@@ -580,4 +586,82 @@ void picture_processing_unit::step() noexcept {
     }
 }
 
+void picture_processing_unit::save_state(state_writer& writer) const noexcept {
+    writer.write<u16>(video_address_bus);
+    writer.write(video_data_bus);
+    writer.write(video_memory_access);
+    writer.write<u8>(cpu_address_bus);
+    writer.write(cpu_data_bus);
+    writer.write(cpu_register_access);
+    writer.write(nmi);
+
+    writer.write(ppu_ctrl);
+    writer.write(ppu_mask);
+    writer.write(ppu_status);
+    writer.write(oam_addr);
+    writer.write(odd_frame);
+    writer.write(palette_ram);
+    writer.write(primary_oam);
+    writer.write(secondary_oam);
+    writer.write(current_vram_address);
+    writer.write(temporary_vram_address);
+    writer.write<u8>(fine_x_scroll);
+    writer.write(first_write);
+
+    writer.write(current_scanline);
+    writer.write(current_scanline_cycle);
+    writer.write(nametable_entry);
+    writer.write(attribute_table_entry);
+    writer.write(lower_background_pattern);
+    writer.write(upper_background_pattern);
+    writer.write(background_pattern_shift_reg);
+    writer.write(background_palette_shift_reg);
+    writer.write<u8>(background_palette_latch);
+    writer.write(sprites);
+    writer.write(internal_data_latch);
+    writer.write(internal_read_buffer);
+
+    writer.write(current_pixel);
+    writer.write(frame_buffer_valid);
+}
+
+void picture_processing_unit::load_state(state_reader& reader) noexcept {
+    video_address_bus = reader.read<u16>();
+    reader.read(video_data_bus);
+    reader.read(video_memory_access);
+    cpu_address_bus = reader.read<u8>();
+    reader.read(cpu_data_bus);
+    reader.read(cpu_register_access);
+    reader.read(nmi);
+
+    reader.read(ppu_ctrl);
+    reader.read(ppu_mask);
+    reader.read(ppu_status);
+    reader.read(oam_addr);
+    reader.read(odd_frame);
+    reader.read(palette_ram);
+    reader.read(primary_oam);
+    reader.read(secondary_oam);
+    reader.read(current_vram_address);
+    reader.read(temporary_vram_address);
+    fine_x_scroll = reader.read<u8>();
+    reader.read(first_write);
+
+    reader.read(current_scanline);
+    reader.read(current_scanline_cycle);
+    reader.read(nametable_entry);
+    reader.read(attribute_table_entry);
+    reader.read(lower_background_pattern);
+    reader.read(upper_background_pattern);
+    reader.read(background_pattern_shift_reg);
+    reader.read(background_palette_shift_reg);
+    background_palette_latch = reader.read<u8>();
+    reader.read(sprites);
+    reader.read(internal_data_latch);
+    reader.read(internal_read_buffer);
+
+    reader.read(current_pixel);
+    reader.read(frame_buffer_valid);
+}
+
 } // namespace nes
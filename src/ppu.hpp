@@ -2,6 +2,8 @@
 #define NES_PPU_HPP
 
 #include "cartridge.hpp"
+#include "cow_array.hpp"
+#include "save_state.hpp"
 #include "types.hpp"
 #include <cassert>
 
@@ -156,9 +158,12 @@ struct picture_processing_unit {
 
     bool nmi{false};
 
+    bool output_enabled{true}; // frame buffer is not written if false
+
     void step() noexcept;
 
-    u8* get_frame_buffer() noexcept { return frame_buffer.data(); }
+    // the pointer changes on the first write after the ppu was copied
+    u8 const* get_frame_buffer() const noexcept { return frame_buffer.data(); }
 
     [[nodiscard]] constexpr bool has_frame_buffer() noexcept {
         auto ret = frame_buffer_valid;
@@ -166,6 +171,16 @@ struct picture_processing_unit {
         return ret;
     }
 
+    constexpr bool rendering_enabled() const noexcept {
+        return ppu_mask.show_background || ppu_mask.show_sprites;
+    }
+
+    [[nodiscard]] constexpr u16 scanline() const noexcept { return current_scanline; }
+
+    // the frame buffer is not part of the state
+    void save_state(state_writer& writer) const noexcept;
+    void load_state(state_reader& reader) noexcept;
+
   private:
     ppu_control_register ppu_ctrl{0};
     ppu_mask_register ppu_mask{0};
@@ -227,7 +242,7 @@ struct picture_processing_unit {
     u8 internal_data_latch{0};  // TODO: decay?
     u8 internal_read_buffer{0}; // updated when reading PPUDATA
 
-    vector<u8> frame_buffer = vector<u8>(256 * 240);
+    cow_array<u8, 256 * 240> frame_buffer;
     u16 current_pixel{0};
     bool frame_buffer_valid = false; // frame buffer contains a complete image (in vblank)
 
@@ -243,9 +258,6 @@ struct picture_processing_unit {
     void update_vram_address() noexcept;
     void shift_registers() noexcept;
 
-    constexpr bool rendering_enabled() const noexcept {
-        return ppu_mask.show_background || ppu_mask.show_sprites;
-    }
     constexpr bool in_visible_scanline() const noexcept { return current_scanline < 240; }
     constexpr bool in_pre_render_scanline() const noexcept { return current_scanline == 261; }
 };
@@ -0,0 +1,184 @@
+#include "rewind_buffer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace nes {
+
+namespace {
+
+// alternating single equal and different bytes are the worst case: two varints per literal byte
+constexpr std::size_t max_encoded_size(std::size_t state_size) noexcept {
+    return (2 * state_size) + (state_size / 64) + 16;
+}
+
+std::byte* write_varint(std::byte* output, std::size_t value) noexcept {
+    while (value >= 0x80) {
+        *output++ = static_cast<std::byte>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    *output++ = static_cast<std::byte>(value);
+    return output;
+}
+
+std::byte const* read_varint(std::byte const* input, std::size_t& value) noexcept {
+    value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        auto const byte = static_cast<u8>(*input++);
+        value |= static_cast<std::size_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return input;
+        }
+    }
+}
+
+// writes current xor previous as (zero run length, literal length, literal bytes) triples
+std::size_t encode(std::span<std::byte const> current, std::span<std::byte const> previous,
+                   std::byte* output) noexcept {
+    assert(current.size() == previous.size());
+
+    auto* out = output;
+    std::size_t const size = current.size();
+    std::size_t i = 0;
+    while (i < size) {
+        auto const zeros_begin = i;
+        while (((i + 8) <= size) && (std::memcmp(&current[i], &previous[i], 8) == 0)) {
+            i += 8;
+        }
+        while ((i < size) && (current[i] == previous[i])) {
+            ++i;
+        }
+
+        auto const literals_begin = i;
+        while ((i < size) && (current[i] != previous[i])) {
+            ++i;
+        }
+        if (literals_begin == i) {
+            break; // trailing zeros need no encoding
+        }
+
+        out = write_varint(out, literals_begin - zeros_begin);
+        out = write_varint(out, i - literals_begin);
+        for (auto j = literals_begin; j < i; ++j) {
+            *out++ = current[j] ^ previous[j];
+        }
+    }
+    return static_cast<std::size_t>(out - output);
+}
+
+} // namespace
+
+rewind_buffer::rewind_buffer(std::size_t state_size, std::size_t memory_size,
+                             std::size_t keyframe_interval)
+    : state_size_{state_size}, keyframe_interval_{std::max<std::size_t>(keyframe_interval, 1)},
+      memory_(std::max(memory_size, 2 * max_encoded_size(state_size))), newest_(state_size),
+      scratch_(max_encoded_size(state_size)) {}
+
+void rewind_buffer::push(std::span<std::byte const> state) {
+    assert(state.size() == state_size_);
+
+    bool const keyframe = entries_.empty() || (states_since_keyframe_ >= keyframe_interval_);
+    if (keyframe) {
+        std::ranges::fill(newest_, std::byte{0});
+        states_since_keyframe_ = 1;
+    } else {
+        ++states_since_keyframe_;
+    }
+    auto const size = encode(state, newest_, scratch_.data());
+
+    // entries are stored back to back, wrapping around to the start of the memory
+    auto const offset = ((head_ + size) <= memory_.size()) ? head_ : 0;
+    while (!is_free(offset, size)) {
+        entries_.pop_front();
+    }
+
+    std::copy_n(scratch_.begin(), size, memory_.begin() + static_cast<std::ptrdiff_t>(offset));
+    entries_.push_back({offset, size, keyframe});
+    head_ = offset + size;
+    std::ranges::copy(state, newest_.begin());
+}
+
+bool rewind_buffer::pop(std::span<std::byte> destination) noexcept {
+    assert(destination.size() == state_size_);
+
+    if (entries_.empty()) {
+        return false;
+    }
+
+    std::ranges::copy(newest_, destination.begin());
+
+    auto const popped = entries_.back();
+    entries_.pop_back();
+    head_ = popped.offset;
+
+    if (!popped.keyframe) {
+        apply(popped, newest_);
+        --states_since_keyframe_;
+        return true;
+    }
+
+    // the state before a keyframe is restored from the keyframe before it
+    auto const keyframe = std::ranges::find_if(entries_.rbegin(), entries_.rend(),
+                                               [](entry const& e) { return e.keyframe; });
+    if (keyframe == entries_.rend()) {
+        // dropped together with the oldest keyframe
+        clear();
+        return true;
+    }
+
+    std::ranges::fill(newest_, std::byte{0});
+    for (auto it = std::prev(keyframe.base()); it != entries_.end(); ++it) {
+        apply(*it, newest_);
+    }
+    states_since_keyframe_ =
+        static_cast<std::size_t>(std::distance(keyframe.base(), entries_.end())) + 1;
+    return true;
+}
+
+void rewind_buffer::clear() noexcept {
+    entries_.clear();
+    head_ = 0;
+    states_since_keyframe_ = 0;
+}
+
+std::size_t rewind_buffer::memory_used() const noexcept {
+    std::size_t used = 0;
+    for (auto const& e : entries_) {
+        used += e.size;
+    }
+    return used;
+}
+
+void rewind_buffer::apply(entry const& e, std::span<std::byte> state) const noexcept {
+    auto const* input = memory_.data() + e.offset;
+    auto const* const end = input + e.size;
+
+    std::size_t position = 0;
+    while (input != end) {
+        std::size_t zeros{};
+        std::size_t literals{};
+        input = read_varint(input, zeros);
+        input = read_varint(input, literals);
+
+        position += zeros;
+        for (std::size_t i = 0; i < literals; ++i) {
+            state[position++] ^= *input++;
+        }
+    }
+}
+
+bool rewind_buffer::is_free(std::size_t offset, std::size_t size) const noexcept {
+    if (entries_.empty()) {
+        return true;
+    }
+
+    auto const first = entries_.front().offset;
+    if (first < head_) {
+        // entries are contiguous in [first, head)
+        return (offset >= head_) || ((offset + size) <= first);
+    }
+    // entries wrap around: [first, end of memory) and [0, head)
+    return (offset >= head_) && ((offset + size) <= first);
+}
+
+} // namespace nes
@@ -0,0 +1,57 @@
+#ifndef NES_REWIND_BUFFER_HPP
+#define NES_REWIND_BUFFER_HPP
+
+#include "types.hpp"
+#include <deque>
+#include <span>
+
+namespace nes {
+
+// history of save states in a fixed amount of memory.
+// every state is stored as the xor with the previous state, with runs of zero bytes left out.
+// only a few hundred bytes change per frame, so a frame usually takes less than a kilobyte.
+// keyframes (the state xor zero) every keyframe_interval states bound the work needed to step
+// back over a keyframe. the oldest states are dropped when the memory is full.
+class rewind_buffer {
+  public:
+    rewind_buffer(std::size_t state_size, std::size_t memory_size,
+                  std::size_t keyframe_interval = 60);
+
+    void push(std::span<std::byte const> state);
+
+    // copies the most recent state into destination and removes it from the history.
+    // returns false if the history is empty.
+    bool pop(std::span<std::byte> destination) noexcept;
+
+    void clear() noexcept;
+
+    [[nodiscard]] std::size_t size() const noexcept { return entries_.size(); }
+    [[nodiscard]] bool empty() const noexcept { return entries_.empty(); }
+    [[nodiscard]] std::size_t memory_used() const noexcept;
+
+  private:
+    struct entry {
+        std::size_t offset;
+        std::size_t size;
+        bool keyframe;
+    };
+
+    // xors the encoded difference into state
+    void apply(entry const& e, std::span<std::byte> state) const noexcept;
+    [[nodiscard]] bool is_free(std::size_t offset, std::size_t size) const noexcept;
+
+    std::size_t state_size_;
+    std::size_t keyframe_interval_;
+    std::size_t states_since_keyframe_{0};
+
+    vector<std::byte> memory_;
+    std::size_t head_{0}; // where the next entry is stored
+    std::deque<entry> entries_;
+
+    vector<std::byte> newest_;  // decoded state of the most recent entry
+    vector<std::byte> scratch_; // encoding output
+};
+
+} // namespace nes
+
+#endif
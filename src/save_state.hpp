@@ -0,0 +1,76 @@
+#ifndef NES_SAVE_STATE_HPP
+#define NES_SAVE_STATE_HPP
+
+#include "types.hpp"
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+namespace nes {
+
+// save states are the trivially copyable parts of every component, copied one after another
+// without padding. there is no pointer in a save state, so it can be written to a file.
+constexpr u32 save_state_version = 5;
+
+class state_writer {
+  public:
+    // an empty destination only counts the bytes
+    explicit constexpr state_writer(std::span<std::byte> destination = {}) noexcept
+        : destination_{destination} {}
+
+    template <typename T>
+    void write(T const& value) noexcept {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(std::as_bytes(std::span{&value, 1}));
+    }
+
+    void write_bytes(std::span<std::byte const> bytes) noexcept {
+        if ((position_ + bytes.size()) <= destination_.size()) {
+            std::memcpy(destination_.data() + position_, bytes.data(), bytes.size());
+        }
+        position_ += bytes.size();
+    }
+
+    [[nodiscard]] constexpr std::size_t size() const noexcept { return position_; }
+
+  private:
+    std::span<std::byte> destination_;
+    std::size_t position_{0};
+};
+
+class state_reader {
+  public:
+    explicit constexpr state_reader(std::span<std::byte const> source) noexcept
+        : source_{source} {}
+
+    template <typename T>
+    void read(T& value) noexcept {
+        static_assert(std::is_trivially_copyable_v<T>);
+        read_bytes(std::as_writable_bytes(std::span{&value, 1}));
+    }
+
+    // for bit fields
+    template <typename T>
+    [[nodiscard]] T read() noexcept {
+        T value{};
+        read(value);
+        return value;
+    }
+
+    void read_bytes(std::span<std::byte> bytes) noexcept {
+        if ((position_ + bytes.size()) <= source_.size()) {
+            std::memcpy(bytes.data(), source_.data() + position_, bytes.size());
+        }
+        position_ += bytes.size();
+    }
+
+    [[nodiscard]] constexpr std::size_t size() const noexcept { return position_; }
+
+  private:
+    std::span<std::byte const> source_;
+    std::size_t position_{0};
+};
+
+} // namespace nes
+
+#endif
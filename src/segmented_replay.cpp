@@ -0,0 +1,139 @@
+#include "segmented_replay.hpp"
+#include "hash.hpp"
+#include "nes.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace nes {
+
+namespace {
+
+// states before the first frame of every segment. with audio the first pass mixes and drops the
+// samples, so that the filters of every segment start where the previous segment left them.
+optional<vector<vector<std::byte>>> take_keyframes(movie const& m,
+                                                   std::shared_ptr<rom_image const> const& rom,
+                                                   u64 segment_frames, std::size_t segment_count,
+                                                   bool audio, movie_index* index) {
+    nintendo_entertainment_system nes{cartridge{rom}};
+    if (!nes.load_state(m.initial_state)) {
+        return std::nullopt;
+    }
+    nes.set_video_output(false);
+    if (!audio) {
+        nes.disable_audio();
+    }
+
+    vector<vector<std::byte>> keyframes(segment_count, vector<std::byte>(nes.state_size()));
+    u64 frame = 0; // nes is in the state before this frame
+    for (std::size_t segment = 0; segment < segment_count; ++segment) {
+        auto const begin = segment * segment_frames;
+        // index states are taken without mixing, so their filters would start silent
+        bool const in_index = !audio && (index != nullptr) && ((begin % index->interval()) == 0) &&
+                              index->load(begin / index->interval(), hash_movie(m, begin), nes);
+        if (in_index) {
+            frame = begin;
+        }
+        for (; frame < begin; ++frame) {
+            nes.set_controller_states(m.input[frame]);
+            nes.run_single_frame();
+            (void)nes.sample_buffer();
+        }
+        nes.save_state(keyframes[segment]);
+    }
+    return keyframes;
+}
+
+} // namespace
+
+bool is_seekable_video_file(std::filesystem::path const& file) {
+    std::error_code error;
+    auto const status = std::filesystem::status(file, error);
+    if (status.type() == std::filesystem::file_type::not_found) {
+        return file != "-";
+    }
+    return !error && std::filesystem::is_regular_file(status);
+}
+
+optional<replay_result> replay_segmented(thread_pool& pool, movie const& m,
+                                         std::shared_ptr<rom_image const> const& rom,
+                                         replay_config const& config, movie_index* index) {
+    u64 const frame_count = m.input.size();
+    u64 const segment_frames = std::max<u32>(config.segment_frames, 1);
+    auto const segment_count = static_cast<std::size_t>(
+        (frame_count + segment_frames - 1) / segment_frames);
+
+    auto const keyframes =
+        take_keyframes(m, rom, segment_frames, segment_count, config.audio, index);
+    if (!keyframes) {
+        return std::nullopt;
+    }
+
+    // the file gets its final size first, so that segments can write in any order
+    auto const header_size = video_header_size(config.video_format);
+    auto const frame_size = video_frame_size(config.video_format);
+    if (config.video_file) {
+        std::ofstream video{*config.video_file, std::ios::binary};
+        write_video_header(video, config.video_format);
+        video.close();
+        std::filesystem::resize_file(*config.video_file, header_size + (frame_count * frame_size));
+    }
+
+    replay_result result{.frame_hashes = vector<u64>(frame_count),
+                         .state_hashes = vector<u64>(frame_count),
+                         .segment_count = segment_count};
+    vector<vector<float>> segment_samples(segment_count);
+
+    // every segment writes only its own frames
+    pool.parallel_for(segment_count, [&](std::size_t segment) {
+        nintendo_entertainment_system nes{cartridge{rom}};
+        nes.load_state((*keyframes)[segment]);
+        if (!config.audio) {
+            nes.disable_audio();
+        }
+
+        std::ofstream video;
+        vector<u8> converted;
+        auto const begin = segment * segment_frames;
+        auto const end = std::min(begin + segment_frames, frame_count);
+        if (config.video_file) {
+            video.open(*config.video_file, std::ios::in | std::ios::out | std::ios::binary);
+            video.seekp(static_cast<std::streamoff>(header_size + (begin * frame_size)));
+            converted.resize(frame_size);
+        }
+
+        for (auto frame = begin; frame < end; ++frame) {
+            nes.set_controller_states(m.input[frame]);
+            nes.run_single_frame();
+
+            std::span<u8 const, frame_pixels> const frame_buffer{nes.frame_buffer(),
+                                                                 frame_pixels};
+            result.frame_hashes[frame] = fnv1a(std::as_bytes(frame_buffer));
+            result.state_hashes[frame] = nes.state_hash();
+            if (config.video_file) {
+                convert_video_frame(config.video_format, frame_buffer, converted);
+                video.write(reinterpret_cast<char const*>(converted.data()),
+                            static_cast<std::streamsize>(converted.size()));
+            }
+            if (config.audio) {
+                auto const samples = nes.sample_buffer();
+                segment_samples[segment].insert(segment_samples[segment].end(), samples.begin(),
+                                                samples.end());
+            }
+        }
+    });
+
+    for (auto const& samples : segment_samples) {
+        result.samples.insert(result.samples.end(), samples.begin(), samples.end());
+    }
+
+    auto const checked = static_cast<std::ptrdiff_t>(std::min(m.state_hashes.size(), frame_count));
+    auto const [expected, actual] = std::mismatch(m.state_hashes.begin(),
+                                                  m.state_hashes.begin() + checked,
+                                                  result.state_hashes.begin());
+    if (expected != (m.state_hashes.begin() + checked)) {
+        result.first_desync = static_cast<u64>(expected - m.state_hashes.begin());
+    }
+    return result;
+}
+
+} // namespace nes
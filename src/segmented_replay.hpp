@@ -0,0 +1,49 @@
+#ifndef NES_SEGMENTED_REPLAY_HPP
+#define NES_SEGMENTED_REPLAY_HPP
+
+#include "cartridge.hpp"
+#include "movie.hpp"
+#include "movie_index.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+#include "video_capture.hpp"
+#include <filesystem>
+#include <memory>
+
+namespace nes {
+
+struct replay_config {
+    u32 segment_frames{600};
+    // every frame in the video format, written by every segment at its own offset. it has to be
+    // a regular file (or not exist yet), see is_seekable_video_file.
+    optional<std::filesystem::path> video_file{};
+    video_file_format video_format{video_file_format::rgba};
+    bool audio{false};
+};
+
+struct replay_result {
+    vector<u64> frame_hashes{};   // fnv-1a of every frame buffer
+    vector<u64> state_hashes{};   // state_hash() after every frame
+    vector<float> samples{};      // audio of all frames if enabled
+    optional<u64> first_desync{}; // first frame that does not match the state hashes of the movie
+    std::size_t segment_count{};
+};
+
+// false for pipes, devices and "-", which replay_segmented cannot write at segment offsets
+bool is_seekable_video_file(std::filesystem::path const& file);
+
+// replays a movie on all threads of the pool. a first pass without video output takes a
+// keyframe at the start of every segment (or loads it from the index, if the movie has one),
+// then every segment is replayed from its keyframe with output enabled and the results are
+// joined in frame order. only the first pass is serial.
+// the video and state hashes and the audio match a serial replay. with audio the first pass
+// also mixes the audio, for exact filter states, and does not use the index.
+// returns nullopt if the initial state of the movie does not fit the rom.
+optional<replay_result> replay_segmented(thread_pool& pool, movie const& m,
+                                         std::shared_ptr<rom_image const> const& rom,
+                                         replay_config const& config,
+                                         movie_index* index = nullptr);
+
+} // namespace nes
+
+#endif
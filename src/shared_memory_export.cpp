@@ -0,0 +1,130 @@
+#include "shared_memory_export.hpp"
+#include <algorithm>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NES_POSIX_SHARED_MEMORY
+#endif
+
+namespace nes {
+
+namespace {
+
+// maps the whole region of a shared memory object, nullptr on failure
+void* map_region(std::string const& name, bool create) noexcept {
+#ifdef NES_POSIX_SHARED_MEMORY
+    if (create) {
+        shm_unlink(name.c_str()); // readers of an old region keep their mapping of it
+    }
+    auto const file = create ? shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644)
+                             : shm_open(name.c_str(), O_RDONLY, 0);
+    if (file < 0) {
+        return nullptr;
+    }
+    constexpr auto size = static_cast<off_t>(sizeof(shared_export_region));
+    struct stat status {};
+    bool const sized = create ? (ftruncate(file, size) == 0)
+                              : ((fstat(file, &status) == 0) && (status.st_size >= size));
+    void* address = sized ? mmap(nullptr, sizeof(shared_export_region),
+                                 create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file, 0)
+                          : MAP_FAILED;
+    close(file);
+    if (address == MAP_FAILED) {
+        if (create) {
+            shm_unlink(name.c_str());
+        }
+        return nullptr;
+    }
+    return address;
+#else
+    (void)name;
+    (void)create;
+    return nullptr;
+#endif
+}
+
+void unmap_region(void const* region) noexcept {
+#ifdef NES_POSIX_SHARED_MEMORY
+    munmap(const_cast<void*>(region), sizeof(shared_export_region));
+#else
+    (void)region;
+#endif
+}
+
+} // namespace
+
+optional<shared_memory_export> shared_memory_export::create(std::string const& name,
+                                                            double sample_rate) {
+    auto* const address = map_region(name, true);
+    if (address == nullptr) {
+        return std::nullopt;
+    }
+
+    // the new object is zero filled, which is a valid state of the atomics and slots
+    auto* const region = static_cast<shared_export_region*>(address);
+    region->magic = shared_export_region::file_magic;
+    region->version = shared_export_region::layout_version;
+    region->slot_count = shared_slot_count;
+    region->sample_rate = sample_rate;
+    return shared_memory_export{name, std::unique_ptr<shared_export_region, unmap>{region}};
+}
+
+shared_memory_export::shared_memory_export(std::string name,
+                                           std::unique_ptr<shared_export_region, unmap> region)
+    : name_{std::move(name)}, region_{std::move(region)} {}
+
+shared_memory_export::~shared_memory_export() {
+#ifdef NES_POSIX_SHARED_MEMORY
+    if (region_) {
+        shm_unlink(name_.c_str());
+    }
+#endif
+}
+
+void shared_memory_export::unmap::operator()(shared_export_region* region) const noexcept {
+    unmap_region(region);
+}
+
+void shared_memory_export::publish(u8 const* frame_buffer, std::span<float const> samples,
+                                   std::span<u8 const> ram) noexcept {
+    auto const frame = region_->frames.load(std::memory_order_relaxed);
+    auto& slot = region_->slots[frame % shared_slot_count];
+
+    slot.sequence.store((2 * frame) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.frame = frame;
+    std::copy_n(frame_buffer, frame_pixels, slot.frame_buffer.begin());
+    auto const sample_count = std::min(samples.size(), shared_max_samples);
+    std::copy_n(samples.begin(), sample_count, slot.samples.begin());
+    slot.sample_count = static_cast<u32>(sample_count);
+    std::copy_n(ram.begin(), std::min(ram.size(), shared_ram_size), slot.ram.begin());
+
+    slot.sequence.store((2 * frame) + 2, std::memory_order_release);
+    region_->frames.store(frame + 1, std::memory_order_release);
+}
+
+optional<shared_memory_reader> shared_memory_reader::open(std::string const& name) {
+    auto const* const address = map_region(name, false);
+    if (address == nullptr) {
+        return std::nullopt;
+    }
+
+    std::unique_ptr<shared_export_region const, unmap> region{
+        static_cast<shared_export_region const*>(address)};
+    if ((region->magic != shared_export_region::file_magic) ||
+        (region->version != shared_export_region::layout_version) ||
+        (region->slot_count != shared_slot_count)) {
+        return std::nullopt;
+    }
+    return shared_memory_reader{std::move(region)};
+}
+
+void shared_memory_reader::unmap::operator()(shared_export_region const* region) const noexcept {
+    unmap_region(region);
+}
+
+} // namespace nes
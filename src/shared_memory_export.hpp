@@ -0,0 +1,119 @@
+#ifndef NES_SHARED_MEMORY_EXPORT_HPP
+#define NES_SHARED_MEMORY_EXPORT_HPP
+
+#include "types.hpp"
+#include "video_capture.hpp"
+#include <atomic>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace nes {
+
+// output of one instance in a posix shared memory region, for other processes on the host
+// (e.g. trainers, recorders and viewers) that read it in place without copies or sockets.
+// every frame is published into the next of three slots. a slot is guarded by a sequence
+// counter that is odd while the slot is written (a seqlock), so readers never block the
+// emulation: they read the newest slot and retry if it was overwritten meanwhile. with three
+// slots a reader has two frames of time before the slot it reads is reused.
+
+constexpr std::size_t shared_slot_count = 3;
+constexpr std::size_t shared_max_samples = 4096; // per frame, more are cut off
+constexpr std::size_t shared_ram_size = 0x800;
+
+struct shared_frame_slot {
+    std::atomic<u64> sequence; // 2 * frame + 1 while written, 2 * frame + 2 when complete
+    u64 frame;
+    u32 sample_count;
+    [[maybe_unused]] u32 padding;
+    array<u8, frame_pixels> frame_buffer; // palette indices
+    array<float, shared_max_samples> samples;
+    array<u8, shared_ram_size> ram;
+};
+
+// the layout of the region. it only changes together with the version.
+struct shared_export_region {
+    static constexpr array<char, 8> file_magic{'N', 'E', 'S', 'S', 'H', 'M', 'E', 'M'};
+    static constexpr u32 layout_version = 1;
+
+    array<char, 8> magic;
+    u32 version;
+    u32 slot_count;
+    double sample_rate;
+    std::atomic<u64> frames; // published frames, the newest is in slot (frames - 1) % 3
+    array<shared_frame_slot, shared_slot_count> slots;
+};
+static_assert(std::atomic<u64>::is_always_lock_free); // also across processes
+
+// publishing side, one per instance
+class shared_memory_export {
+  public:
+    // creates the region with the given name (e.g. "/nes0"), an existing one is replaced.
+    // nullopt if it cannot be created (or without posix shared memory).
+    static optional<shared_memory_export> create(std::string const& name, double sample_rate);
+    ~shared_memory_export(); // removes the region, mappings of readers stay valid
+
+    shared_memory_export(shared_memory_export&&) noexcept = default;
+    shared_memory_export& operator=(shared_memory_export&&) = delete;
+
+    // after every frame, e.g. with nes.frame_buffer(), nes.sample_buffer() and nes.ram()
+    void publish(u8 const* frame_buffer, std::span<float const> samples,
+                 std::span<u8 const> ram) noexcept;
+
+  private:
+    struct unmap {
+        void operator()(shared_export_region* region) const noexcept;
+    };
+
+    shared_memory_export(std::string name, std::unique_ptr<shared_export_region, unmap> region);
+
+    std::string name_;
+    std::unique_ptr<shared_export_region, unmap> region_;
+};
+
+// reading side, in another process
+class shared_memory_reader {
+  public:
+    // nullopt if the region does not exist or has another layout
+    static optional<shared_memory_reader> open(std::string const& name);
+
+    [[nodiscard]] double sample_rate() const noexcept { return region_->sample_rate; }
+
+    // published frames so far, polled to wait for the next one
+    [[nodiscard]] u64 frames() const noexcept {
+        return region_->frames.load(std::memory_order_acquire);
+    }
+
+    // calls read(slot) with the newest frame in place and returns true if the slot was not
+    // overwritten meanwhile. otherwise what read saw is torn and has to be discarded. false
+    // without a call before the first frame.
+    template <typename Function>
+    bool read_latest(Function&& read) const {
+        auto const published = frames();
+        if (published == 0) {
+            return false;
+        }
+        auto const& slot = region_->slots[(published - 1) % shared_slot_count];
+        auto const sequence = slot.sequence.load(std::memory_order_acquire);
+        if ((sequence % 2) != 0) {
+            return false;
+        }
+        read(slot);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+  private:
+    struct unmap {
+        void operator()(shared_export_region const* region) const noexcept;
+    };
+
+    explicit shared_memory_reader(std::unique_ptr<shared_export_region const, unmap> region)
+        : region_{std::move(region)} {}
+
+    std::unique_ptr<shared_export_region const, unmap> region_;
+};
+
+} // namespace nes
+
+#endif
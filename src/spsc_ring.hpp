@@ -0,0 +1,94 @@
+#ifndef NES_SPSC_RING_HPP
+#define NES_SPSC_RING_HPP
+
+#include "types.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <span>
+
+namespace nes {
+
+// lock-free ring buffer for one producer thread and one consumer thread (e.g. the emulation and
+// the audio callback). the indices count up forever and are masked on access. each side keeps a
+// copy of the other side's index and only reloads it when the ring looks full or empty, so the
+// shared cache lines move between the cores at most once per call.
+template <typename T>
+class spsc_ring {
+  public:
+    // the capacity is rounded up to a power of two
+    explicit spsc_ring(std::size_t capacity)
+        : elements_(std::bit_ceil(std::max(capacity, std::size_t{1}))),
+          mask_{elements_.size() - 1} {}
+
+    spsc_ring(spsc_ring const&) = delete;
+    spsc_ring& operator=(spsc_ring const&) = delete;
+
+    // producer: appends as many elements as fit, returns their number
+    std::size_t push(std::span<T const> source) noexcept {
+        auto const write = producer_.index.load(std::memory_order_relaxed);
+        auto free = elements_.size() - (write - producer_.other_index);
+        if (free < source.size()) {
+            producer_.other_index = consumer_.index.load(std::memory_order_acquire);
+            free = elements_.size() - (write - producer_.other_index);
+        }
+        auto const count = std::min(source.size(), free);
+
+        copy(source.first(count), write, [](T const& from, T& to) { to = from; });
+        producer_.index.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer: removes up to destination.size() elements, returns their number
+    std::size_t pop(std::span<T> destination) noexcept {
+        auto const read = consumer_.index.load(std::memory_order_relaxed);
+        auto available = consumer_.other_index - read;
+        if (available < destination.size()) {
+            consumer_.other_index = producer_.index.load(std::memory_order_acquire);
+            available = consumer_.other_index - read;
+        }
+        auto const count = std::min(destination.size(), available);
+
+        copy(destination.first(count), read, [](T& to, T const& from) { to = from; });
+        consumer_.index.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    // elements in the ring. a snapshot while the other side is running.
+    [[nodiscard]] std::size_t size() const noexcept {
+        auto const read = consumer_.index.load(std::memory_order_acquire);
+        return producer_.index.load(std::memory_order_acquire) - read;
+    }
+
+    [[nodiscard]] std::size_t capacity() const noexcept { return elements_.size(); }
+
+  private:
+    // applies assign(range element, ring element) to the ring elements starting at index, in
+    // at most two contiguous parts
+    template <typename Span, typename Assign>
+    void copy(Span range, std::size_t index, Assign assign) noexcept {
+        auto const begin = index & mask_;
+        auto const first = std::min(range.size(), elements_.size() - begin);
+        for (std::size_t i = 0; i < first; ++i) {
+            assign(range[i], elements_[begin + i]);
+        }
+        for (std::size_t i = first; i < range.size(); ++i) {
+            assign(range[i], elements_[i - first]);
+        }
+    }
+
+    // written by one side, read by the other. separate cache lines avoid false sharing.
+    struct alignas(64) side {
+        std::atomic<std::size_t> index{0};
+        std::size_t other_index{0}; // cached index of the other side
+    };
+
+    side producer_;
+    side consumer_;
+    vector<T> elements_;
+    std::size_t mask_;
+};
+
+} // namespace nes
+
+#endif
@@ -0,0 +1,125 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace nes {
+
+namespace {
+
+constexpr u64 pack(std::size_t begin, std::size_t end) noexcept {
+    return (static_cast<u64>(begin) << 32) | static_cast<u64>(end);
+}
+constexpr std::size_t begin_of(u64 indices) noexcept { return indices >> 32; }
+constexpr std::size_t end_of(u64 indices) noexcept { return indices & 0xffff'ffff; }
+
+} // namespace
+
+thread_pool::thread_pool(std::size_t thread_count)
+    : ranges_(std::max<std::size_t>(thread_count, 1)) {
+    // the last range belongs to the thread calling parallel_for
+    for (std::size_t i = 0; (i + 1) < ranges_.size(); ++i) {
+        workers_.emplace_back([this, i] {
+            u64 generation = 0;
+            while (true) {
+                {
+                    std::unique_lock lock{mutex_};
+                    start_.wait(lock, [&] { return stop_ || (generation_ != generation); });
+                    if (stop_) {
+                        return;
+                    }
+                    generation = generation_;
+                }
+
+                work(i);
+
+                std::scoped_lock const lock{mutex_};
+                if (--busy_workers_ == 0) {
+                    done_.notify_one();
+                }
+            }
+        });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::scoped_lock const lock{mutex_};
+        stop_ = true;
+    }
+    start_.notify_all();
+    workers_.clear(); // joins before the members they use are destroyed
+}
+
+void thread_pool::parallel_for(std::size_t count,
+                               std::function<void(std::size_t)> const& function) {
+    assert(count <= 0xffff'ffff);
+
+    std::scoped_lock const loop_lock{parallel_for_mutex_};
+
+    auto const threads = ranges_.size();
+    for (std::size_t i = 0; i < threads; ++i) {
+        ranges_[i].indices.store(pack(count * i / threads, count * (i + 1) / threads),
+                                 std::memory_order_relaxed);
+    }
+
+    {
+        std::scoped_lock const lock{mutex_};
+        function_ = &function;
+        busy_workers_ = workers_.size();
+        ++generation_;
+    }
+    start_.notify_all();
+
+    work(ranges_.size() - 1);
+
+    std::unique_lock lock{mutex_};
+    done_.wait(lock, [&] { return busy_workers_ == 0; });
+    function_ = nullptr;
+}
+
+void thread_pool::work(std::size_t thread_index) noexcept {
+    auto const& function = *function_;
+    while (true) {
+        auto index = take(thread_index);
+        if (!index) {
+            index = steal(thread_index);
+        }
+        if (!index) {
+            return;
+        }
+        function(*index);
+    }
+}
+
+optional<std::size_t> thread_pool::take(std::size_t thread_index) noexcept {
+    auto& indices = ranges_[thread_index].indices;
+    auto current = indices.load(std::memory_order_relaxed);
+    while (begin_of(current) < end_of(current)) {
+        if (indices.compare_exchange_weak(current, pack(begin_of(current) + 1, end_of(current)),
+                                          std::memory_order_relaxed)) {
+            return begin_of(current);
+        }
+    }
+    return std::nullopt;
+}
+
+optional<std::size_t> thread_pool::steal(std::size_t thread_index) noexcept {
+    for (std::size_t offset = 1; offset < ranges_.size(); ++offset) {
+        auto& victim = ranges_[(thread_index + offset) % ranges_.size()].indices;
+        auto current = victim.load(std::memory_order_relaxed);
+        while (begin_of(current) < end_of(current)) {
+            // the upper half of the remaining indices
+            auto const middle = begin_of(current) + ((end_of(current) - begin_of(current)) / 2);
+            if (victim.compare_exchange_weak(current, pack(begin_of(current), middle),
+                                             std::memory_order_relaxed)) {
+                // own range is empty, nobody else writes it
+                ranges_[thread_index].indices.store(pack(middle + 1, end_of(current)),
+                                                    std::memory_order_relaxed);
+                return middle;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace nes
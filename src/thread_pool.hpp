@@ -0,0 +1,57 @@
+#ifndef NES_THREAD_POOL_HPP
+#define NES_THREAD_POOL_HPP
+
+#include "types.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace nes {
+
+// persistent worker threads for data parallel loops.
+// every thread starts with an equal share of the indices and steals half of the remaining
+// indices of another thread when it runs out, so uneven work (e.g. sessions of different
+// length) is balanced without a central queue.
+class thread_pool {
+  public:
+    // the calling thread of parallel_for counts as one of the threads
+    explicit thread_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+    ~thread_pool();
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    [[nodiscard]] std::size_t size() const noexcept { return ranges_.size(); }
+
+    // calls function(i) for every i in [0, count) and returns when all calls are done.
+    // function must not throw.
+    void parallel_for(std::size_t count, std::function<void(std::size_t)> const& function);
+
+  private:
+    // [begin, end) packed into one word so that taking and stealing are single cas operations
+    struct alignas(64) range {
+        std::atomic<u64> indices{0};
+    };
+
+    void work(std::size_t thread_index) noexcept;
+    [[nodiscard]] optional<std::size_t> take(std::size_t thread_index) noexcept;
+    [[nodiscard]] optional<std::size_t> steal(std::size_t thread_index) noexcept;
+
+    vector<range> ranges_;
+    vector<std::jthread> workers_;
+
+    std::mutex parallel_for_mutex_; // one loop at a time
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    std::function<void(std::size_t)> const* function_{nullptr};
+    u64 generation_{0};
+    std::size_t busy_workers_{0};
+    bool stop_{false};
+};
+
+} // namespace nes
+
+#endif
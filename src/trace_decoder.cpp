@@ -0,0 +1,27 @@
+#include "diagnostics/execution_trace.hpp"
+#include <fstream>
+#include <iostream>
+
+// prints a binary execution trace written by the emulator as a nestest style log
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace file>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream input{argv[1], std::ios::binary};
+    if (!input) {
+        std::cerr << "Could not open " << argv[1] << '\n';
+        return EXIT_FAILURE;
+    }
+
+    auto const records = nes::read_execution_trace(input);
+    if (!records) {
+        std::cerr << "Unsupported trace file format\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ios::sync_with_stdio(false);
+    nes::print_execution_trace(*records, std::cout);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "vector_environment.hpp"
+#include "nes.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace nes {
+
+namespace {
+
+constexpr std::size_t ram_size = 2048;
+
+} // namespace
+
+vector_environment::vector_environment(std::shared_ptr<rom_image const> const& rom,
+                                       std::size_t count, environment_config config,
+                                       thread_pool& pool)
+    : config_{std::move(config)}, pool_{pool} {
+    std::size_t frame_size = 0;
+    if (config_.frame_observation) {
+        encoder_.emplace(*config_.frame_observation);
+        frame_size = encoder_->format().size();
+        if (encoder_->format().max_pool) {
+            previous_frames_.resize(count * frame_size);
+        }
+    }
+    observation_size_ = frame_size + (config_.ram_observation ? ram_size : 0);
+    observations_.resize(count * observation_size_);
+    done_.resize(count);
+    episode_frames_.resize(count);
+
+    instances_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        instances_.push_back(std::make_unique<nintendo_entertainment_system>(cartridge{rom}));
+        instances_.back()->disable_audio();
+    }
+
+    if (count > 0) {
+        initial_state_.resize(instances_.front()->state_size());
+        instances_.front()->save_state(initial_state_);
+    }
+    reset();
+}
+
+vector_environment::~vector_environment() = default;
+
+void vector_environment::reset() {
+    pool_.parallel_for(size(), [&](std::size_t i) {
+        start_episode(i);
+        write_observation(i);
+        if (encoder_) {
+            // the frame buffer still holds the last picture of the previous episode, which
+            // neither the observation nor the max pooling of the first step may see
+            std::fill_n(observation_begin(i), encoder_->format().size(), u8{0});
+            if (!previous_frames_.empty()) {
+                std::ranges::fill(previous_frame(i), u8{0});
+            }
+        }
+    });
+}
+
+void vector_environment::step(std::span<controller_states const> actions) {
+    assert(actions.size() == size());
+
+    pool_.parallel_for(size(), [&](std::size_t i) {
+        if (done_[i] != 0) {
+            start_episode(i);
+        }
+
+        auto& nes = *instances_[i];
+        nes.set_controller_states(actions[i]);
+        nes.run_single_frame();
+        ++episode_frames_[i];
+
+        write_observation(i);
+        done_[i] = ((config_.max_episode_frames != 0) &&
+                    (episode_frames_[i] >= config_.max_episode_frames)) ||
+                   (config_.is_terminal && config_.is_terminal(nes.ram()));
+    });
+}
+
+void vector_environment::start_episode(std::size_t index) noexcept {
+    instances_[index]->load_state(initial_state_);
+    episode_frames_[index] = 0;
+    done_[index] = 0;
+    if (!previous_frames_.empty()) {
+        std::ranges::fill(previous_frame(index), u8{0});
+    }
+}
+
+void vector_environment::write_observation(std::size_t index) noexcept {
+    auto& nes = *instances_[index];
+    auto output = observation_begin(index);
+    if (encoder_) {
+        std::span const frame{output, encoder_->format().size()};
+        encoder_->encode(nes.frame_buffer(), frame);
+        if (!previous_frames_.empty()) {
+            max_pool(frame, previous_frame(index));
+        }
+        output += static_cast<std::ptrdiff_t>(frame.size());
+    }
+    if (config_.ram_observation) {
+        std::ranges::copy(nes.ram(), output);
+    }
+}
+
+} // namespace nes
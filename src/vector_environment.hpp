@@ -0,0 +1,76 @@
+#ifndef NES_VECTOR_ENVIRONMENT_HPP
+#define NES_VECTOR_ENVIRONMENT_HPP
+
+#include "cartridge.hpp"
+#include "controller.hpp"
+#include "observation.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+#include <functional>
+#include <memory>
+#include <span>
+
+namespace nes {
+
+class nintendo_entertainment_system;
+
+struct environment_config {
+    // full resolution palette indices by default, e.g. {84, 84, color_mode::greyscale} for agents
+    optional<observation_format> frame_observation{observation_format{}};
+    bool ram_observation{false}; // 2 kb cpu ram, after the frame if both are enabled
+    u32 max_episode_frames{0};    // 0 for no limit
+    // called with the cpu ram after every step, optional
+    std::function<bool(std::span<u8 const>)> is_terminal{};
+};
+
+// steps a batch of emulators in lockstep, one frame per step.
+// observations of all instances are stored back to back in one buffer that stays valid.
+// an instance that is done starts a new episode from the power-on state with the next step.
+class vector_environment {
+  public:
+    vector_environment(std::shared_ptr<rom_image const> const& rom, std::size_t count,
+                       environment_config config, thread_pool& pool);
+    ~vector_environment();
+
+    // all instances start a new episode. the frame observation is zero until the first step.
+    void reset();
+
+    // actions[i] is the controller input for instance i
+    void step(std::span<controller_states const> actions);
+
+    [[nodiscard]] std::size_t size() const noexcept { return instances_.size(); }
+    [[nodiscard]] std::size_t observation_size() const noexcept { return observation_size_; }
+    [[nodiscard]] std::span<u8 const> observations() const noexcept { return observations_; }
+    [[nodiscard]] std::span<u8 const> observation(std::size_t index) const noexcept {
+        return observations().subspan(index * observation_size_, observation_size_);
+    }
+    // one byte per instance, not vector<bool> so that threads can write them independently
+    [[nodiscard]] std::span<u8 const> done() const noexcept { return done_; }
+
+  private:
+    void start_episode(std::size_t index) noexcept;
+    void write_observation(std::size_t index) noexcept;
+    [[nodiscard]] auto observation_begin(std::size_t index) noexcept {
+        return observations_.begin() + static_cast<std::ptrdiff_t>(index * observation_size_);
+    }
+    [[nodiscard]] std::span<u8> previous_frame(std::size_t index) noexcept {
+        auto const size = encoder_->format().size();
+        return std::span{previous_frames_}.subspan(index * size, size);
+    }
+
+    environment_config config_;
+    thread_pool& pool_;
+    vector<std::unique_ptr<nintendo_entertainment_system>> instances_;
+    vector<std::byte> initial_state_;
+    optional<observation_encoder> encoder_;
+
+    std::size_t observation_size_{0};
+    vector<u8> observations_;
+    vector<u8> previous_frames_; // unpooled frame observations, for max pooling
+    vector<u8> done_;
+    vector<u32> episode_frames_;
+};
+
+} // namespace nes
+
+#endif
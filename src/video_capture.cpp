@@ -0,0 +1,155 @@
+#include "video_capture.hpp"
+#include "palette.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+
+namespace nes {
+
+namespace {
+
+// ntsc frame rate 39375000 / 655171 hz and the 8:7 pixel aspect ratio of the ntsc ppu
+constexpr std::string_view y4m_header =
+    "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n";
+constexpr std::string_view y4m_frame_header = "FRAME\n";
+
+struct ycbcr {
+    u8 y;
+    u8 cb;
+    u8 cr;
+};
+
+// bt.601 limited range of every palette color
+constexpr auto ycbcr_palette = [] {
+    array<ycbcr, 64> result{};
+    for (std::size_t i = 0; i < result.size(); ++i) {
+        auto const [r, g, b] = color_palette[i];
+        auto const y = 16.0 + (((65.481 * r) + (128.553 * g) + (24.966 * b)) / 255.0);
+        auto const cb = 128.0 + (((-37.797 * r) - (74.203 * g) + (112.0 * b)) / 255.0);
+        auto const cr = 128.0 + (((112.0 * r) - (93.786 * g) - (18.214 * b)) / 255.0);
+        result[i] = {static_cast<u8>(y + 0.5), static_cast<u8>(cb + 0.5),
+                     static_cast<u8>(cr + 0.5)};
+    }
+    return result;
+}();
+
+constexpr auto rgba_palette = [] {
+    array<array<u8, 4>, 64> result{};
+    for (std::size_t i = 0; i < result.size(); ++i) {
+        auto const [r, g, b] = color_palette[i];
+        result[i] = {r, g, b, 255};
+    }
+    return result;
+}();
+
+} // namespace
+
+video_file_format video_file_format_for(std::filesystem::path const& file) {
+    auto const extension = file.extension();
+    if (extension == ".y4m") {
+        return video_file_format::y4m;
+    }
+    return (extension == ".indices") ? video_file_format::palette_indices
+                                     : video_file_format::rgba;
+}
+
+std::size_t video_header_size(video_file_format format) noexcept {
+    return (format == video_file_format::y4m) ? y4m_header.size() : 0;
+}
+
+std::size_t video_frame_size(video_file_format format) noexcept {
+    switch (format) {
+    case video_file_format::palette_indices: return frame_pixels;
+    case video_file_format::rgba: return 4 * frame_pixels;
+    case video_file_format::y4m: return y4m_frame_header.size() + (3 * frame_pixels);
+    }
+    return 0;
+}
+
+void write_video_header(std::ostream& out, video_file_format format) {
+    if (format == video_file_format::y4m) {
+        out.write(y4m_header.data(), static_cast<std::streamsize>(y4m_header.size()));
+    }
+}
+
+void convert_video_frame(video_file_format format, std::span<u8 const, frame_pixels> indices,
+                         std::span<u8> destination) noexcept {
+    switch (format) {
+    case video_file_format::palette_indices: {
+        std::ranges::copy(indices, destination.begin());
+    } break;
+    case video_file_format::rgba: {
+        for (std::size_t i = 0; i < frame_pixels; ++i) {
+            std::memcpy(&destination[4 * i], rgba_palette[indices[i] & 0x3f].data(), 4);
+        }
+    } break;
+    case video_file_format::y4m: {
+        std::ranges::copy(y4m_frame_header, destination.begin());
+        auto const planes = destination.subspan(y4m_frame_header.size());
+        for (std::size_t i = 0; i < frame_pixels; ++i) {
+            auto const color = ycbcr_palette[indices[i] & 0x3f];
+            planes[i] = color.y;
+            planes[frame_pixels + i] = color.cb;
+            planes[(2 * frame_pixels) + i] = color.cr;
+        }
+    } break;
+    }
+}
+
+video_capture::video_capture(std::ostream& out, video_file_format format,
+                             std::size_t pool_frames)
+    : out_{out}, format_{format}, frames_(std::max<std::size_t>(pool_frames, 1)),
+      filled_{frames_.size()}, recycled_{frames_.size()} {
+    for (std::size_t i = 0; i < frames_.size(); ++i) {
+        recycled_.push(std::span{&i, 1});
+    }
+    thread_ = std::jthread{[this] { write_frames(); }};
+}
+
+video_capture::~video_capture() {
+    stop_.store(true, std::memory_order_release);
+    pushes_.fetch_add(1, std::memory_order_release);
+    pushes_.notify_one();
+    thread_.join();
+    out_.flush();
+}
+
+void video_capture::push(u8 const* frame_buffer) noexcept {
+    std::size_t frame{};
+    if (recycled_.pop(std::span{&frame, 1}) == 0) {
+        ++dropped_frames_;
+        return;
+    }
+    std::copy_n(frame_buffer, frame_pixels, frames_[frame].begin());
+    filled_.push(std::span{&frame, 1});
+    pushes_.fetch_add(1, std::memory_order_release);
+    pushes_.notify_one();
+}
+
+void video_capture::write_frames() {
+    write_video_header(out_, format_);
+
+    vector<u8> converted(video_frame_size(format_));
+    auto const drain = [&] {
+        std::size_t frame{};
+        while (filled_.pop(std::span{&frame, 1}) == 1) {
+            convert_video_frame(format_, frames_[frame], converted);
+            recycled_.push(std::span{&frame, 1});
+            out_.write(reinterpret_cast<char const*>(converted.data()),
+                       static_cast<std::streamsize>(converted.size()));
+        }
+    };
+
+    for (;;) {
+        auto const pushes = pushes_.load(std::memory_order_acquire);
+        drain();
+        if (stop_.load(std::memory_order_acquire)) {
+            drain(); // what was pushed before the stop
+            return;
+        }
+        pushes_.wait(pushes, std::memory_order_acquire);
+    }
+}
+
+} // namespace nes
@@ -0,0 +1,71 @@
+#ifndef NES_VIDEO_CAPTURE_HPP
+#define NES_VIDEO_CAPTURE_HPP
+
+#include "spsc_ring.hpp"
+#include "types.hpp"
+#include <atomic>
+#include <filesystem>
+#include <iosfwd>
+#include <span>
+#include <thread>
+
+namespace nes {
+
+constexpr std::size_t frame_width = 256;
+constexpr std::size_t frame_height = 240;
+constexpr std::size_t frame_pixels = frame_width * frame_height;
+
+enum class video_file_format : u8 {
+    palette_indices, // one byte per pixel, as the ppu renders them
+    rgba,            // 4 bytes per pixel
+    y4m,             // yuv4mpeg2 stream with 4:4:4 bt.601 frames, for encoders like ffmpeg
+};
+
+// y4m for files ending in .y4m, palette indices for .indices and rgba otherwise (e.g. a pipe)
+video_file_format video_file_format_for(std::filesystem::path const& file);
+
+// bytes of the stream header and of every frame including its frame header
+std::size_t video_header_size(video_file_format format) noexcept;
+std::size_t video_frame_size(video_file_format format) noexcept;
+
+void write_video_header(std::ostream& out, video_file_format format);
+
+// converts one frame of palette indices. destination has video_frame_size(format) bytes.
+void convert_video_frame(video_file_format format, std::span<u8 const, frame_pixels> indices,
+                         std::span<u8> destination) noexcept;
+
+// records every frame on a background thread, e.g. into a pipe to an encoder. push() copies the
+// palette indices into a free buffer of a fixed pool and returns, the thread converts and writes
+// them and puts the buffer back. if the writer falls behind by the whole pool the frame is
+// dropped and counted instead of slowing the emulation. there is no allocation per frame.
+class video_capture {
+  public:
+    // the stream is only used by the writer thread until destruction
+    video_capture(std::ostream& out, video_file_format format, std::size_t pool_frames = 8);
+    ~video_capture();
+
+    video_capture(video_capture const&) = delete;
+    video_capture& operator=(video_capture const&) = delete;
+
+    // emulation thread, e.g. nes.frame_buffer() after every frame
+    void push(u8 const* frame_buffer) noexcept;
+
+    [[nodiscard]] u64 dropped_frames() const noexcept { return dropped_frames_; }
+
+  private:
+    void write_frames();
+
+    std::ostream& out_;
+    video_file_format format_;
+    vector<array<u8, frame_pixels>> frames_;
+    spsc_ring<std::size_t> filled_;   // frames to write, emulation to writer
+    spsc_ring<std::size_t> recycled_; // frames to reuse, writer to emulation
+    std::atomic<u64> pushes_{0};      // the writer thread sleeps until this changes
+    std::atomic<bool> stop_{false};
+    u64 dropped_frames_{0};
+    std::jthread thread_;
+};
+
+} // namespace nes
+
+#endif
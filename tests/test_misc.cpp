@@ -1,8 +1,93 @@
+#include "audio_capture.hpp"
+#include "batch_runner.hpp"
+#include "diagnostics/execution_trace.hpp"
+#include "diagnostics/timeline.hpp"
+#include "hash.hpp"
+#include "movie.hpp"
+#include "movie_index.hpp"
+#include "nes.hpp"
+#include "observation.hpp"
+#include "palette.hpp"
 #include "oam_dma.hpp"
+#include "rewind_buffer.hpp"
+#include "segmented_replay.hpp"
+#include "shared_memory_export.hpp"
+#include "spsc_ring.hpp"
+#include "thread_pool.hpp"
+#include "vector_environment.hpp"
+#include "video_capture.hpp"
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <thread>
 
 using namespace nes;
 
+namespace {
+
+// nrom game that keeps the ppu, oam dma and the apu busy, with nmi enabled
+std::shared_ptr<rom_image const> make_test_rom() {
+    rom_image rom{.prg_rom = vector<u8>(0x4000), .chr_rom = vector<u8>(0x2000)};
+    for (std::size_t i = 0; i < rom.chr_rom.size(); ++i) {
+        rom.chr_rom[i] = static_cast<u8>(i * 7);
+    }
+
+    // clang-format off
+    constexpr array<u8, 60> program{
+        0xa9, 0x1e, 0x8d, 0x01, 0x20, // LDA #$1E, STA $2001
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80, STA $2000
+        0xa9, 0x0f, 0x8d, 0x15, 0x40, // LDA #$0F, STA $4015
+        0xa9, 0xbf, 0x8d, 0x00, 0x40, // LDA #$BF, STA $4000
+        0xa9, 0x80, 0x8d, 0x02, 0x40, // LDA #$80, STA $4002
+        0xa9, 0x01, 0x8d, 0x03, 0x40, // LDA #$01, STA $4003
+        0xe6, 0x10,                   // loop: INC $10
+        0xa9, 0x21, 0x8d, 0x06, 0x20, // LDA #$21, STA $2006
+        0xa5, 0x10, 0x8d, 0x06, 0x20, // LDA $10, STA $2006
+        0x8d, 0x07, 0x20,             // STA $2007
+        0x8d, 0x00, 0x02,             // STA $0200
+        0xa9, 0x02, 0x8d, 0x14, 0x40, // LDA #$02, STA $4014
+        0x4c, 0x1e, 0x80,             // JMP loop
+    };
+    constexpr array<u8, 3> nmi_handler{
+        0xe6, 0x11, // INC $11
+        0x40,       // RTI
+    };
+    // clang-format on
+    std::ranges::copy(program, rom.prg_rom.begin());
+    std::ranges::copy(nmi_handler, rom.prg_rom.begin() + 0x0100);
+
+    // nmi and irq at $8100, reset at $8000
+    std::ranges::copy(array<u8, 6>{0x00, 0x81, 0x00, 0x80, 0x00, 0x81}, rom.prg_rom.end() - 6);
+    return std::make_shared<rom_image const>(std::move(rom));
+}
+
+// a backdrop color that changes all the time, for tests that need differing frames
+std::shared_ptr<rom_image const> make_color_cycling_rom() {
+    rom_image rom{.prg_rom = vector<u8>(0x4000), .chr_rom = vector<u8>(0x2000)};
+
+    // clang-format off
+    constexpr array<u8, 22> program{
+        0xa9, 0x1e, 0x8d, 0x01, 0x20, // LDA #$1E, STA $2001
+        0xe6, 0x10,                   // loop: INC $10
+        0xa9, 0x3f, 0x8d, 0x06, 0x20, // LDA #$3F, STA $2006
+        0xa9, 0x00, 0x8d, 0x06, 0x20, // LDA #$00, STA $2006
+        0xa5, 0x10,                   // LDA $10
+        0x8d, 0x07, 0x20,             // STA $2007
+    };
+    // clang-format on
+    std::ranges::copy(program, rom.prg_rom.begin());
+    std::ranges::copy(array<u8, 3>{0x4c, 0x05, 0x80}, rom.prg_rom.begin() + program.size());
+
+    std::ranges::copy(array<u8, 6>{0x00, 0x80, 0x00, 0x80, 0x00, 0x80}, rom.prg_rom.end() - 6);
+    return std::make_shared<rom_image const>(std::move(rom));
+}
+
+} // namespace
+
 TEST_CASE("oam_dma") {
     cpu_state cpu{.address_bus = 0x1234};
     auto state = std::make_optional<oam_dma_state>(u8{0x04}, false);
@@ -37,3 +122,1140 @@ TEST_CASE("oam_dma") {
     }
     CHECK(loop_count == 256);
 }
+
+TEST_CASE("execution_trace") {
+    execution_trace trace{3}; // rounded up to 4
+    cpu_state cpu{};
+
+    for (u64 cycle = 0; cycle < 6; ++cycle) {
+        cpu.cycle_count = cycle;
+        cpu.pc = static_cast<u16>(0x8000 + cycle);
+        trace.record(cpu);
+    }
+    CHECK(trace.size() == 4);
+
+    auto const [older, newer] = trace.records();
+    REQUIRE(older.size() + newer.size() == 4);
+    CHECK(older.front().cycle == 2);
+    CHECK(older.back().pc == 0x8003);
+    CHECK(newer.back().cycle == 5);
+
+    auto const trace_file = std::filesystem::temp_directory_path() / "nes_test_trace.bin";
+    REQUIRE(trace.write_file(trace_file.string().c_str()));
+    std::ifstream input{trace_file, std::ios::binary};
+    auto const records = read_execution_trace(input);
+    REQUIRE(records);
+    REQUIRE(records->size() == 4);
+    CHECK(records->front().cycle == 2);
+    CHECK(records->back().cycle == 5);
+    input.close();
+    std::filesystem::remove(trace_file);
+}
+
+TEST_CASE("guest_profiler") {
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    nes.run_single_frame(); // the setup code runs in the first frame
+    nes.reset_statistics();
+
+    nes.enable_guest_profiler();
+    constexpr u64 frames = 10;
+    for (u64 frame = 0; frame < frames; ++frame) {
+        nes.run_single_frame();
+    }
+    auto const& profiler = *nes.get_guest_profiler();
+
+    // the opcode counts add up to the cycles run
+    u64 opcode_cycles{0};
+    u64 executions{0};
+    for (u32 opcode = 0; opcode < 256; ++opcode) {
+        opcode_cycles += profiler.opcode_cycles(static_cast<u8>(opcode));
+        executions += profiler.opcode_executions(static_cast<u8>(opcode));
+    }
+    if constexpr (perf_counters_enabled) {
+        CHECK(opcode_cycles == nes.statistics().cpu_cycles);
+    }
+    // 341 * 262 dots per frame with rendering on, one less on odd frames, 3 dots per cpu cycle
+    constexpr u64 frame_dots = 341 * 262;
+    CHECK(opcode_cycles * 3 >= (frame_dots * frames) - (frames / 2) - 3);
+    CHECK(opcode_cycles * 3 <= (frame_dots * frames) - (frames / 2) + 3);
+    CHECK(executions > 0);
+    CHECK(profiler.opcode_executions(0x8d) > profiler.opcode_executions(0x4c)); // STA, JMP
+
+    // the hottest instructions are those of the loop, led by the oam dma store
+    vector<u32> addresses(0x10000);
+    std::iota(addresses.begin(), addresses.end(), 0u);
+    std::ranges::sort(addresses, [&](u32 lhs, u32 rhs) {
+        return profiler.address_cycles(static_cast<u16>(lhs)) >
+               profiler.address_cycles(static_cast<u16>(rhs));
+    });
+    CHECK(addresses.front() == 0x8032);
+    for (auto const address : std::span{addresses}.first(10)) {
+        CHECK(address >= 0x801e);
+        CHECK(address <= 0x803a);
+    }
+
+    u64 address_cycles{0};
+    u64 loop_cycles{0};
+    for (u32 address = 0; address < 0x10000; ++address) {
+        auto const cycles_at = profiler.address_cycles(static_cast<u16>(address));
+        address_cycles += cycles_at;
+        loop_cycles += ((address >= 0x801e) && (address <= 0x803a)) ? cycles_at : 0;
+    }
+    CHECK(address_cycles == opcode_cycles);
+    CHECK(loop_cycles > address_cycles * 99 / 100); // the rest is the nmi handler
+}
+
+TEST_CASE("perf counters") {
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    nes.run_single_frame(); // the first frame starts at power-on
+    (void)nes.sample_buffer();
+    nes.reset_statistics();
+
+    constexpr u64 frames = 10;
+    for (u64 frame = 0; frame < frames; ++frame) {
+        nes.run_single_frame(); // the samples are not fetched, like in a headless run
+    }
+    auto const statistics = nes.statistics();
+    auto const samples = nes.sample_buffer().size();
+    if constexpr (!perf_counters_enabled) {
+        CHECK(statistics.frames == 0);
+        CHECK(statistics.cpu_cycles == 0);
+        return;
+    }
+
+    CHECK(statistics.frames == frames);
+    // 29780.5 cpu cycles per frame with rendering enabled
+    CHECK(statistics.cpu_cycles >= (frames * 29780));
+    CHECK(statistics.cpu_cycles <= (frames * 29781));
+    CHECK((statistics.ppu_dots_rendered + statistics.ppu_dots_skipped) ==
+          (3 * statistics.cpu_cycles));
+    CHECK(statistics.dma_cycles > 0); // the test rom runs an oam dma in every loop
+    CHECK(statistics.dma_cycles < statistics.cpu_cycles);
+    CHECK(statistics.ppu_register_accesses > 0);
+    CHECK(statistics.audio_samples == samples);
+    if constexpr (audio_synthesis_enabled) {
+        CHECK(samples > (frames * 730));
+    }
+}
+
+TEST_CASE("timeline") {
+    using namespace std::chrono_literals;
+    timeline::enable();
+    auto const start = timeline::clock::now();
+    // nested scopes end inner first
+    timeline::record_scope("test \"inner\"", start + 1ms, start + 2ms);
+    timeline::record_counter("test counter", 42.5);
+    timeline::record_scope("test outer", start, start + 3ms);
+
+    // a thread that records more events than its ring holds keeps the newest
+    constexpr u64 wrap_events = (1u << 17) + 10;
+    std::thread{[] {
+        for (u64 i = 0; i < wrap_events; ++i) {
+            timeline::record_counter("test wrap", static_cast<double>(i));
+        }
+    }}.join();
+    timeline::enable(false);
+
+    std::stringstream trace;
+    timeline::write_chrome_trace(trace);
+    auto const text = trace.str();
+    CHECK(text.starts_with("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"));
+    CHECK(text.ends_with("}\n]}\n"));
+
+    // one event object per line
+    vector<std::string> events;
+    std::string line;
+    std::getline(trace, line);
+    while (std::getline(trace, line) && (line != "]}")) {
+        if (line.ends_with(",")) {
+            line.pop_back();
+        }
+        events.push_back(line);
+    }
+    bool json_objects = true;
+    for (auto const& event : events) {
+        json_objects = json_objects && event.starts_with("{\"name\":") && event.ends_with("}") &&
+                       (event.find("\"pid\":1,\"tid\":") != std::string::npos);
+    }
+    CHECK(json_objects);
+
+    auto const find = [&](std::string_view name) {
+        return std::ranges::find_if(
+            events, [&](auto const& event) { return event.find(name) != std::string::npos; });
+    };
+    auto const inner = find("\"test \\\"inner\\\"\"");
+    auto const counter = find("\"test counter\"");
+    auto const outer = find("\"test outer\"");
+    REQUIRE(inner != events.end());
+    REQUIRE(outer != events.end());
+    REQUIRE(counter != events.end());
+    CHECK(inner < counter); // in recording order
+    CHECK(counter < outer);
+    CHECK(inner->find("\"ph\":\"X\",\"dur\":1000}") != std::string::npos);
+    CHECK(outer->find("\"ph\":\"X\",\"dur\":3000}") != std::string::npos);
+    CHECK(counter->ends_with("\"ph\":\"C\",\"args\":{\"value\":42.5}}"));
+
+    auto const wrapped = std::ranges::count_if(
+        events, [](auto const& event) { return event.find("\"test wrap\"") != std::string::npos; });
+    CHECK(static_cast<u64>(wrapped) == (1u << 17));
+    auto const oldest = find("\"test wrap\"");
+    REQUIRE(oldest != events.end());
+    CHECK(oldest->ends_with("{\"value\":10}}"));
+    auto const newest = std::ranges::find_if(events.rbegin(), events.rend(), [](auto const& event) {
+        return event.find("\"test wrap\"") != std::string::npos;
+    });
+    CHECK(newest->ends_with("{\"value\":" + std::to_string(wrap_events - 1) + "}}"));
+}
+
+TEST_CASE("save_state") {
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    auto const run_frames = [&](int count) {
+        vector<float> samples;
+        for (int frame = 0; frame < count; ++frame) {
+            nes.run_single_frame();
+            auto const new_samples = nes.sample_buffer();
+            samples.insert(samples.end(), new_samples.begin(), new_samples.end());
+        }
+        return std::pair{vector<u8>(nes.frame_buffer(), nes.frame_buffer() + 256 * 240), samples};
+    };
+
+    run_frames(10);
+    vector<std::byte> state(nes.state_size());
+    REQUIRE(nes.save_state(state) == state.size());
+    CHECK(nes.save_state(std::span{state}.first(state.size() - 1)) == 0);
+
+    auto const expected = run_frames(5);
+    REQUIRE(nes.load_state(state));
+    auto const actual = run_frames(5);
+    CHECK(actual.first == expected.first);
+    CHECK(actual.second == expected.second);
+
+    CHECK_FALSE(nes.load_state(std::span{state}.first(state.size() - 1)));
+    state[0] = std::byte{0};
+    CHECK_FALSE(nes.load_state(state));
+}
+
+TEST_CASE("fork") {
+    nintendo_entertainment_system parent{cartridge{make_test_rom()}};
+    for (int frame = 0; frame < 3; ++frame) {
+        parent.run_single_frame();
+    }
+    auto const ram = vector<u8>(parent.ram().begin(), parent.ram().end());
+    auto const frame = vector<u8>(parent.frame_buffer(), parent.frame_buffer() + 256 * 240);
+
+    // the fork shares the memory of the parent until it runs
+    auto const child = parent.fork();
+    CHECK(child->ram().data() == parent.ram().data());
+    CHECK(child->frame_buffer() == parent.frame_buffer());
+
+    child->run_single_frame();
+    CHECK(child->ram().data() != parent.ram().data());
+    CHECK(std::ranges::equal(parent.ram(), ram));
+    CHECK(std::equal(frame.begin(), frame.end(), parent.frame_buffer()));
+
+    // and continues exactly like the parent would
+    parent.run_single_frame();
+    CHECK(std::ranges::equal(parent.ram(), child->ram()));
+    CHECK(std::equal(parent.frame_buffer(), parent.frame_buffer() + 256 * 240,
+                     child->frame_buffer()));
+    CHECK(std::ranges::equal(parent.sample_buffer(), child->sample_buffer()));
+
+    // writes of the parent after a fork do not reach the fork either
+    auto const second_child = parent.fork();
+    auto const second_ram = vector<u8>(parent.ram().begin(), parent.ram().end());
+    parent.run_single_frame();
+    CHECK(second_child->ram().data() != parent.ram().data());
+    CHECK(std::ranges::equal(second_child->ram(), second_ram));
+    CHECK(!std::ranges::equal(parent.ram(), second_ram));
+}
+
+TEST_CASE("shared rom_image") {
+    auto const rom = make_test_rom();
+    cartridge first{rom};
+    cartridge second{rom};
+    CHECK(first.rom() == second.rom());
+
+    // ram is per instance, rom is never written
+    first.write(0x6000, 0x12);
+    first.write(0x8000, 0x34);
+    CHECK(first.read(0x6000) == 0x12);
+    CHECK(second.read(0x6000) == 0x00);
+    CHECK(first.read(0x8000) == rom->prg_rom[0]);
+    CHECK(first.read(0xc000) == rom->prg_rom[0]); // 16 KiB prg rom is mirrored
+
+    // no chr rom means chr ram
+    auto const chr_ram_rom = std::make_shared<rom_image const>(
+        rom_image{.prg_rom = vector<u8>(0x4000), .chr_rom = {}});
+    cartridge third{chr_ram_rom};
+    REQUIRE(third.chr_ram().size() == 0x2000);
+    third.write_chr(0x1234, 0x56);
+    CHECK(third.read_chr(0x1234) == 0x56);
+    first.write_chr(0x1234, 0x56);
+    CHECK(first.read_chr(0x1234) == rom->chr_rom[0x1234]);
+}
+
+TEST_CASE("rewind_buffer") {
+    constexpr std::size_t state_size = 1000;
+    vector<vector<std::byte>> states;
+    vector<std::byte> state(state_size);
+    for (std::size_t i = 0; i < 400; ++i) {
+        state[(i * 37) % state_size] = static_cast<std::byte>(i);
+        state[(i * 101) % state_size] ^= std::byte{0xff};
+        states.push_back(state);
+    }
+
+    vector<std::byte> popped(state_size);
+
+    SECTION("all states fit") {
+        rewind_buffer history{state_size, 1 << 20, 8};
+        for (auto const& s : states) {
+            history.push(s);
+        }
+        CHECK(history.size() == states.size());
+        CHECK(history.memory_used() < (states.size() * state_size / 10));
+
+        for (auto it = states.rbegin(); it != states.rend(); ++it) {
+            REQUIRE(history.pop(popped));
+            CHECK(popped == *it);
+        }
+        CHECK_FALSE(history.pop(popped));
+    }
+
+    SECTION("oldest states are dropped") {
+        rewind_buffer history{state_size, 5000, 8}; // memory for about two keyframes
+        for (auto const& s : states) {
+            history.push(s);
+        }
+        CHECK(history.size() < states.size());
+
+        auto expected = states.rbegin();
+        while (history.pop(popped)) {
+            CHECK(popped == *expected++);
+        }
+        CHECK(expected != states.rbegin());
+    }
+}
+
+TEST_CASE("suppressed output") {
+    nintendo_entertainment_system reference{cartridge{make_test_rom()}};
+    nintendo_entertainment_system suppressed{cartridge{make_test_rom()}};
+    suppressed.set_video_output(false);
+    suppressed.set_audio_output(false);
+
+    for (int frame = 0; frame < 10; ++frame) {
+        reference.run_single_frame();
+        suppressed.set_video_output(frame == 9);
+        suppressed.run_single_frame();
+    }
+
+    CHECK(suppressed.sample_buffer().empty());
+    if constexpr (audio_synthesis_enabled) {
+        CHECK_FALSE(reference.sample_buffer().empty());
+    }
+    CHECK(std::equal(reference.frame_buffer(), reference.frame_buffer() + 256 * 240,
+                     suppressed.frame_buffer()));
+}
+
+TEST_CASE("sample rate") {
+    // 60 frames are 60 * 29780.5 cpu cycles. the first frame after power on is shorter.
+    auto const run = [](double sample_rate) {
+        nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+        nes.set_sample_rate(sample_rate);
+        nes.run_single_frame();
+        nes.sample_buffer();
+        std::size_t samples = 0;
+        for (int frame = 0; frame < 60; ++frame) {
+            nes.run_single_frame();
+            samples += nes.sample_buffer().size();
+        }
+        return std::pair{samples, nes.state_hash()};
+    };
+    auto const expected_samples = [](double sample_rate) {
+        return sample_rate * 60 * 29780.5 / audio_processing_unit::clock_rate;
+    };
+
+    auto const [samples_44100, hash_44100] = run(44100.0);
+    auto const [samples_48000, hash_48000] = run(48000.0);
+    auto const [samples_adjusted, hash_adjusted] = run(48000.0 * 1.005);
+    if constexpr (audio_synthesis_enabled) {
+        CHECK(std::abs(static_cast<double>(samples_44100) - expected_samples(44100.0)) < 2.0);
+        CHECK(std::abs(static_cast<double>(samples_48000) - expected_samples(48000.0)) < 2.0);
+        CHECK(std::abs(static_cast<double>(samples_adjusted) -
+                       expected_samples(48000.0 * 1.005)) < 2.0);
+    } else {
+        CHECK(samples_44100 + samples_48000 + samples_adjusted == 0);
+    }
+
+    // the output rate does not affect the emulation
+    CHECK(hash_44100 == hash_48000);
+    CHECK(hash_44100 == hash_adjusted);
+}
+
+TEST_CASE("apu catch-up") {
+    // writing an unused register makes the apu catch up, so doing it every cycle emulates
+    // every cycle. the lazy apu has to produce the same interrupts and samples.
+    audio_processing_unit lazy;
+    audio_processing_unit eager;
+    auto const write = [&](u16 address, u8 value) {
+        lazy.write(address, value);
+        eager.write(address, value);
+    };
+    write(0x4015, 0x0f);
+    write(0x4017, 0x00); // four step mode with interrupt
+
+    bool same_interrupts = true;
+    for (u32 cycle = 0; cycle < 120000; ++cycle) {
+        if ((cycle % 997) == 0) {
+            // notes of all channels with changing periods, lengths and envelopes
+            auto const value = static_cast<u8>(cycle / 997);
+            write(0x4000, value);
+            write(0x4002, static_cast<u8>(value * 3));
+            write(0x4003, value & 0x0f);
+            write(0x4004, static_cast<u8>(value ^ 0xbf));
+            write(0x4006, 0x20);
+            write(0x4007, 0x08);
+            write(0x4008, 0x81);
+            write(0x400a, value);
+            write(0x400b, 0x08);
+            write(0x400c, 0x3f);
+            write(0x400e, value);
+            write(0x400f, 0x08);
+        }
+        if (cycle == 70000) {
+            write(0x4017, 0x80); // five step mode
+        }
+        eager.write(0x4009, 0);
+        lazy.step();
+        eager.step();
+        same_interrupts = same_interrupts && (lazy.interrupt() == eager.interrupt());
+        if ((cycle % 29781) == 0) {
+            lazy.end_frame();
+            eager.end_frame();
+        }
+    }
+    lazy.end_frame();
+    eager.end_frame();
+
+    CHECK(same_interrupts);
+    auto const lazy_samples = lazy.get_sample_buffer();
+    auto const eager_samples = eager.get_sample_buffer();
+    CHECK(lazy_samples.empty() == !audio_synthesis_enabled);
+    CHECK(std::ranges::equal(lazy_samples, eager_samples));
+}
+
+TEST_CASE("dmc") {
+    // a sample played by the lazy and an eager apu, the bytes are handed over by the test
+    audio_processing_unit lazy;
+    audio_processing_unit eager;
+    auto const write = [&](u16 address, u8 value) {
+        lazy.write(address, value);
+        eager.write(address, value);
+    };
+    write(0x4010, 0x8f); // interrupt, no loop, 54 cycles per bit
+    write(0x4012, 0xff); // $ffc0
+    write(0x4013, 0x04); // 65 bytes
+    write(0x4015, 0x10);
+
+    vector<u32> fetch_cycles;
+    vector<u16> fetch_addresses;
+    bool same_requests = true;
+    bool early_interrupt = false;
+    for (u32 cycle = 0; cycle < 30000; ++cycle) {
+        eager.write(0x4009, 0);
+        // step() reports every request at the cycle it comes up
+        bool const lazy_request = lazy.step();
+        bool const eager_request = eager.step();
+        same_requests = same_requests && (lazy_request == lazy.dma_request()) &&
+                        (eager_request == eager.dma_request()) &&
+                        (lazy.dma_request() == eager.dma_request()) &&
+                        (lazy.interrupt() == eager.interrupt());
+        early_interrupt = early_interrupt || (lazy.interrupt() && (fetch_cycles.size() < 65));
+        if (lazy.dma_request()) {
+            fetch_cycles.push_back(cycle);
+            fetch_addresses.push_back(lazy.dma_address());
+            lazy.complete_dma(static_cast<u8>(cycle * 37));
+        }
+        if (eager.dma_request()) {
+            eager.complete_dma(static_cast<u8>(cycle * 37));
+        }
+    }
+    lazy.end_frame();
+    eager.end_frame();
+
+    CHECK(same_requests);
+    CHECK_FALSE(early_interrupt);
+    REQUIRE(fetch_cycles.size() == 65);
+    CHECK(fetch_cycles.front() == 0);
+    for (std::size_t i = 2; i < fetch_cycles.size(); ++i) {
+        CHECK(fetch_cycles[i] - fetch_cycles[i - 1] == 8 * 54); // one byte every 8 bits
+    }
+    CHECK(fetch_addresses.front() == 0xffc0);
+    CHECK(fetch_addresses[63] == 0xffff);
+    CHECK(fetch_addresses.back() == 0x8000); // wraps around to $8000
+
+    auto const lazy_samples = lazy.get_sample_buffer();
+    CHECK(lazy_samples.empty() == !audio_synthesis_enabled);
+    CHECK(std::ranges::equal(lazy_samples, eager.get_sample_buffer()));
+
+    // finished with an interrupt, which only a $4015 write acknowledges
+    CHECK(lazy.interrupt());
+    CHECK(lazy.read(0x4015) == 0x80);
+    CHECK(lazy.read(0x4015) == 0x80);
+    lazy.write(0x4015, 0x00);
+    CHECK_FALSE(lazy.interrupt());
+
+    // restarting asks for the first byte again, disabling drops the request
+    lazy.write(0x4015, 0x10);
+    CHECK(lazy.dma_request());
+    CHECK(lazy.dma_address() == 0xffc0);
+    CHECK((lazy.read(0x4015) & 0x10) != 0);
+    lazy.write(0x4015, 0x00);
+    CHECK_FALSE(lazy.dma_request());
+    CHECK((lazy.read(0x4015) & 0x10) == 0);
+}
+
+TEST_CASE("dmc dma") {
+    // a looping sample at the highest rate, so that the dmc fetches all the time
+    rom_image rom{.prg_rom = vector<u8>(0x4000), .chr_rom = vector<u8>(0x2000)};
+    // clang-format off
+    constexpr array<u8, 23> program{
+        0xa9, 0x4f, 0x8d, 0x10, 0x40, // LDA #$4F, STA $4010
+        0xa9, 0x00, 0x8d, 0x12, 0x40, // LDA #$00, STA $4012
+        0xa9, 0xff, 0x8d, 0x13, 0x40, // LDA #$FF, STA $4013
+        0xa9, 0x10, 0x8d, 0x15, 0x40, // LDA #$10, STA $4015
+        0x4c, 0x14, 0x80,             // JMP *
+    };
+    // clang-format on
+    std::ranges::copy(program, rom.prg_rom.begin());
+    std::ranges::copy(array<u8, 6>{0x00, 0x80, 0x00, 0x80, 0x00, 0x80}, rom.prg_rom.end() - 6);
+    nintendo_entertainment_system nes{cartridge{std::make_shared<rom_image const>(rom)}};
+    nes.enable_execution_trace(1);
+    nes.run_single_frame();
+    auto const cycle = [&] { return nes.get_execution_trace()->records().first.back().cycle; };
+    auto const first_cycle = cycle();
+    nes.enable_guest_profiler();
+
+    // the cycles the cpu is stalled for the fetches are counted too, 341 * 262 / 3 per frame
+    constexpr u64 frames = 10;
+    for (u64 frame = 0; frame < frames; ++frame) {
+        nes.run_single_frame();
+    }
+    auto const cycles = cycle() - first_cycle;
+    CHECK(cycles * 3 >= (frames * 341 * 262) - 3);
+    CHECK(cycles * 3 <= (frames * 341 * 262) + 3);
+
+    // and charged to the instruction that was halted, the jmp of the loop. the trace misses
+    // the stalled cycles at the ends of the measurement.
+    auto const& profiler = *nes.get_guest_profiler();
+    auto const profiled = profiler.address_cycles(0x8014);
+    CHECK(profiler.opcode_cycles(0x4c) == profiled);
+    CHECK(profiled + 4 >= cycles);
+    CHECK(profiled <= cycles + 4);
+}
+
+TEST_CASE("audio disabled") {
+    // the cpu visible state is the same without audio
+    audio_processing_unit silent;
+    audio_processing_unit reference;
+    silent.disable_audio();
+    auto const write = [&](u16 address, u8 value) {
+        silent.write(address, value);
+        reference.write(address, value);
+    };
+    write(0x4015, 0x0f);
+    write(0x4017, 0x00);
+
+    bool same_interrupts = true;
+    bool same_status = true;
+    u8 seen_enabled = 0;
+    u8 seen_disabled = 0;
+    for (u32 cycle = 0; cycle < 240000; ++cycle) {
+        if ((cycle % 60000) == 0) {
+            // lengths of 2 half frames that run out between the writes
+            write(0x4000, 0x00);
+            write(0x4003, 0x03 << 3);
+            write(0x4008, 0x01);
+            write(0x400b, 0x03 << 3);
+            write(0x400c, 0x00);
+            write(0x400f, 0x03 << 3);
+        }
+        silent.step();
+        reference.step();
+        same_interrupts = same_interrupts && (silent.interrupt() == reference.interrupt());
+        if ((cycle % 5003) == 0) {
+            auto const status = reference.read(0x4015);
+            same_status = same_status && (silent.read(0x4015) == status);
+            seen_enabled |= status;
+            seen_disabled |= static_cast<u8>(~status);
+        }
+        if ((cycle % 29781) == 0) {
+            silent.end_frame();
+            reference.end_frame();
+        }
+    }
+
+    CHECK(same_interrupts);
+    CHECK(same_status);
+    CHECK((seen_enabled & seen_disabled & 0x0d) == 0x0d); // the lengths ran out
+    CHECK(silent.get_sample_buffer().empty());
+    CHECK(reference.get_sample_buffer().empty() == !audio_synthesis_enabled);
+
+    // the states have the same layout
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    auto const size = nes.state_size();
+    nes.disable_audio();
+    nes.run_single_frame();
+    CHECK(nes.state_size() == size);
+    CHECK(nes.sample_buffer().empty());
+}
+
+TEST_CASE("audio stems") {
+    // the test rom plays pulse 1, the silent triangle still outputs its first step. with a
+    // single tnd channel the mix is the sum of the stems.
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    nes.enable_audio_stems();
+
+    bool same_sizes = true;
+    bool sum_is_mix = true;
+    bool others_silent = true;
+    for (int frame = 0; frame < 10; ++frame) {
+        nes.run_single_frame();
+        auto const mixed = nes.sample_buffer();
+        auto const pulse1 = nes.stem_buffer(audio_channel::pulse1);
+        auto const triangle = nes.stem_buffer(audio_channel::triangle);
+        for (std::size_t i = 0; i < mixed.size(); ++i) {
+            sum_is_mix = sum_is_mix && (std::abs(pulse1[i] + triangle[i] - mixed[i]) < 1e-5f);
+        }
+        for (auto const channel :
+             {audio_channel::pulse2, audio_channel::noise, audio_channel::dmc}) {
+            auto const stem = nes.stem_buffer(channel);
+            others_silent = others_silent && std::ranges::all_of(stem, [](float sample) {
+                                return sample == 0.0f;
+                            });
+            same_sizes = same_sizes && (stem.size() == mixed.size());
+        }
+        same_sizes = same_sizes && (pulse1.size() == mixed.size()) &&
+                     (triangle.size() == mixed.size());
+        CHECK(mixed.empty() == !audio_synthesis_enabled);
+    }
+    CHECK(same_sizes);
+    CHECK(sum_is_mix);
+    CHECK(others_silent);
+
+    nes.disable_audio_stems();
+    nes.run_single_frame();
+    CHECK(nes.stem_buffer(audio_channel::pulse1).empty());
+}
+
+TEST_CASE("movie") {
+    auto const rom = make_test_rom();
+
+    movie recorded{.rom_hash = hash_rom(*rom)};
+    {
+        nintendo_entertainment_system nes{cartridge{rom}};
+        recorded.initial_state.resize(nes.state_size());
+        nes.save_state(recorded.initial_state);
+        for (u8 frame = 0; frame < 4; ++frame) {
+            controller_states const input{.joy1 = {.a = (frame % 2) != 0, .right = true},
+                                          .joy2 = {.start = frame == 3}};
+            nes.set_controller_states(input);
+            nes.run_single_frame();
+            recorded.input.push_back(input);
+            recorded.state_hashes.push_back(nes.state_hash());
+        }
+    }
+
+    std::stringstream file;
+    write_movie(file, recorded);
+    auto const played = read_movie(file);
+    REQUIRE(played);
+    CHECK(played->rom_hash == recorded.rom_hash);
+    CHECK(played->initial_state == recorded.initial_state);
+    REQUIRE(played->input.size() == 4);
+    CHECK(played->input[3].joy2.start);
+    CHECK(played->state_hashes == recorded.state_hashes);
+
+    nintendo_entertainment_system nes{cartridge{rom}};
+    REQUIRE(nes.load_state(played->initial_state));
+    for (std::size_t frame = 0; frame < played->input.size(); ++frame) {
+        nes.set_controller_states(played->input[frame]);
+        nes.run_single_frame();
+        CHECK(nes.state_hash() == played->state_hashes[frame]);
+    }
+
+    auto truncated = file.str();
+    truncated.resize(truncated.size() - 1);
+    std::istringstream truncated_file{truncated};
+    CHECK_FALSE(read_movie(truncated_file));
+
+    // sizes in a corrupted header are rejected before they are allocated
+    for (std::size_t const offset : {24, 32}) { // state size, frame count
+        auto corrupted = file.str();
+        u64 const huge = u64{1} << 62;
+        std::memcpy(corrupted.data() + offset, &huge, sizeof(huge));
+        std::istringstream corrupted_file{corrupted};
+        CHECK_FALSE(read_movie(corrupted_file));
+    }
+}
+
+TEST_CASE("movie_index") {
+    auto const rom = make_test_rom();
+
+    nintendo_entertainment_system nes{cartridge{rom}};
+    movie m{.rom_hash = hash_rom(*rom)};
+    m.initial_state.resize(nes.state_size());
+    nes.save_state(m.initial_state);
+    for (u8 frame = 0; frame < 10; ++frame) {
+        m.input.push_back({.joy1 = {.a = (frame % 3) == 0}});
+    }
+
+    // state hashes before every frame by replaying from the start
+    vector<u64> expected;
+    for (auto const input : m.input) {
+        expected.push_back(nes.state_hash());
+        nes.set_controller_states(input);
+        nes.run_single_frame();
+    }
+    expected.push_back(nes.state_hash());
+    auto const last_frame = vector<u8>(nes.frame_buffer(), nes.frame_buffer() + 256 * 240);
+
+    auto const index_file = std::filesystem::temp_directory_path() / "nes_test_movie.idx";
+    {
+        std::ofstream out{index_file, std::ios::binary};
+        write_movie_index(m, rom, out, 3);
+    }
+    auto index = movie_index::open(index_file, nes.state_size());
+    REQUIRE(index);
+    CHECK(index->interval() == 3);
+    CHECK(index->size() == 4); // before frames 0, 3, 6 and 9
+
+    for (u64 frame : {0, 1, 3, 4, 9, 10}) {
+        CHECK(seek(nes, m, &*index, frame));
+        CHECK(nes.state_hash() == expected[frame]);
+    }
+    CHECK(std::equal(last_frame.begin(), last_frame.end(), nes.frame_buffer()));
+    CHECK_FALSE(seek(nes, m, &*index, 11));
+
+    // keyframes of another movie are not used: this one starts a frame later
+    auto other = m;
+    REQUIRE(seek(nes, m, &*index, 1));
+    nes.save_state(other.initial_state);
+    CHECK(seek(nes, other, &*index, 9));
+    CHECK(nes.state_hash() == expected[10]);
+
+    index.reset();
+    std::filesystem::remove(index_file);
+}
+
+TEST_CASE("audio capture") {
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    vector<float> expected;
+    std::stringstream file;
+    u64 dropped{0};
+    {
+        audio_capture capture{file, audio_file_format::wav, 44100};
+        for (int frame = 0; frame < 30; ++frame) {
+            nes.run_single_frame();
+            auto const samples = nes.sample_buffer();
+            expected.insert(expected.end(), samples.begin(), samples.end());
+            capture.push(samples);
+        }
+        dropped = capture.dropped_samples();
+    }
+    CHECK(dropped == 0);
+    CHECK(expected.empty() == !audio_synthesis_enabled);
+
+    auto const bytes = file.str();
+    REQUIRE(bytes.size() == 44 + (expected.size() * sizeof(float)));
+    auto const field = [&](std::size_t offset, std::size_t size) {
+        u32 value{0};
+        std::memcpy(&value, bytes.data() + offset, size);
+        return value;
+    };
+    CHECK(bytes.substr(0, 4) == "RIFF");
+    CHECK(field(4, 4) == bytes.size() - 8);
+    CHECK(bytes.substr(8, 8) == "WAVEfmt ");
+    CHECK(field(20, 2) == 3); // float
+    CHECK(field(22, 2) == 1); // mono
+    CHECK(field(24, 4) == 44100);
+    CHECK(bytes.substr(36, 4) == "data");
+    CHECK(field(40, 4) == expected.size() * sizeof(float));
+    vector<float> samples(expected.size());
+    std::memcpy(samples.data(), bytes.data() + 44, samples.size() * sizeof(float));
+    CHECK(samples == expected);
+
+    // raw has no header. what does not fit into the ring is dropped instead of waited for.
+    vector<float> const ramp = [] {
+        vector<float> result(1000);
+        std::iota(result.begin(), result.end(), 0.0f);
+        return result;
+    }();
+    std::stringstream raw;
+    {
+        audio_capture capture{raw, audio_file_format::raw, 44100, 16};
+        capture.push(ramp);
+        dropped = capture.dropped_samples();
+    }
+    CHECK(dropped >= ramp.size() - 16);
+    CHECK(raw.str().size() == (ramp.size() - dropped) * sizeof(float));
+
+    CHECK(audio_file_format_for("out.wav") == audio_file_format::wav);
+    CHECK(audio_file_format_for("out.f32") == audio_file_format::raw);
+}
+
+TEST_CASE("video capture") {
+    array<u8, frame_pixels> indices{};
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = static_cast<u8>(i % 64);
+    }
+    vector<u8> rgba(video_frame_size(video_file_format::rgba));
+    convert_video_frame(video_file_format::rgba, indices, rgba);
+    CHECK(rgba[(4 * 33) + 0] == color_palette[33].r);
+    CHECK(rgba[(4 * 33) + 1] == color_palette[33].g);
+    CHECK(rgba[(4 * 33) + 2] == color_palette[33].b);
+    CHECK(rgba[(4 * 33) + 3] == 255);
+
+    vector<u8> y4m(video_frame_size(video_file_format::y4m));
+    convert_video_frame(video_file_format::y4m, indices, y4m);
+    CHECK(std::string(y4m.begin(), y4m.begin() + 6) == "FRAME\n");
+    CHECK(y4m[6 + 0x0f] == 16);                        // black
+    CHECK(y4m[6 + frame_pixels + 0x0f] == 128);        // no chroma
+    CHECK(y4m[6 + (2 * frame_pixels) + 0x0f] == 128);
+    CHECK(y4m[6 + 0x30] > 200);                        // white
+
+    // every pushed frame is written in order
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    vector<u8> expected;
+    std::stringstream file;
+    u64 dropped{0};
+    {
+        video_capture capture{file, video_file_format::y4m, 4};
+        for (int frame = 0; frame < 20; ++frame) {
+            nes.run_single_frame();
+            std::span<u8 const, frame_pixels> const frame_buffer{nes.frame_buffer(),
+                                                                 frame_pixels};
+            convert_video_frame(video_file_format::y4m, frame_buffer, y4m);
+            capture.push(nes.frame_buffer());
+            if (frame < 4) {
+                expected.insert(expected.end(), y4m.begin(), y4m.end()); // fit into the pool
+            }
+        }
+        dropped = capture.dropped_frames();
+    }
+    auto const text = file.str();
+    vector<u8> const bytes(text.begin(), text.end());
+    auto const header_size = video_header_size(video_file_format::y4m);
+    CHECK(text.starts_with("YUV4MPEG2 W256 H240 "));
+    CHECK(bytes[header_size - 1] == '\n');
+    CHECK(bytes.size() == header_size + ((20 - dropped) * y4m.size()));
+    CHECK(std::equal(expected.begin(), expected.end(), bytes.begin() + header_size));
+
+    // the segments of a replay write their frames in place
+    auto const rom = make_test_rom();
+    nintendo_entertainment_system replayed{cartridge{rom}};
+    movie m{.rom_hash = hash_rom(*rom), .input = vector<controller_states>(5)};
+    m.initial_state.resize(replayed.state_size());
+    replayed.save_state(m.initial_state);
+    auto const video_file = std::filesystem::temp_directory_path() / "nes_test_video.y4m";
+    CHECK(video_file_format_for(video_file) == video_file_format::y4m);
+    CHECK(video_file_format_for("frames.indices") == video_file_format::palette_indices);
+    CHECK(video_file_format_for("-") == video_file_format::rgba);
+    CHECK(is_seekable_video_file(video_file));
+    CHECK_FALSE(is_seekable_video_file("-"));
+    CHECK_FALSE(is_seekable_video_file(std::filesystem::temp_directory_path()));
+    thread_pool pool{2};
+    replay_segmented(pool, m, rom,
+                     {.segment_frames = 2,
+                      .video_file = video_file,
+                      .video_format = video_file_format::y4m});
+    for (int frame = 0; frame < 5; ++frame) {
+        replayed.run_single_frame();
+    }
+    std::span<u8 const, frame_pixels> const last_frame{replayed.frame_buffer(), frame_pixels};
+    convert_video_frame(video_file_format::y4m, last_frame, y4m);
+    std::ifstream video{video_file, std::ios::binary};
+    vector<u8> const replay_bytes{std::istreambuf_iterator<char>{video}, {}};
+    CHECK(replay_bytes.size() == header_size + (5 * y4m.size()));
+    CHECK(std::equal(y4m.begin(), y4m.end(), replay_bytes.end() - std::ssize(y4m)));
+    video.close();
+    std::filesystem::remove(video_file);
+}
+
+TEST_CASE("shared memory export") {
+    std::string const name = "/nes_test_export";
+    auto exporter = shared_memory_export::create(name, 48000.0);
+    REQUIRE(exporter);
+    auto const reader = shared_memory_reader::open(name);
+    REQUIRE(reader);
+    CHECK(reader->sample_rate() == 48000.0);
+    CHECK_FALSE(reader->read_latest([](shared_frame_slot const&) {}));
+
+    nintendo_entertainment_system nes{cartridge{make_test_rom()}};
+    for (int frame = 0; frame < 5; ++frame) {
+        nes.run_single_frame();
+        exporter->publish(nes.frame_buffer(), nes.sample_buffer(), nes.ram());
+    }
+    CHECK(reader->frames() == 5);
+    bool same_frame = false;
+    bool same_ram = false;
+    u32 sample_count{0};
+    CHECK(reader->read_latest([&](shared_frame_slot const& slot) {
+        same_frame = (slot.frame == 4) &&
+                     std::equal(slot.frame_buffer.begin(), slot.frame_buffer.end(),
+                                nes.frame_buffer());
+        same_ram = std::ranges::equal(slot.ram, nes.ram());
+        sample_count = slot.sample_count;
+    }));
+    CHECK(same_frame);
+    CHECK(same_ram);
+    CHECK((sample_count > 700) == audio_synthesis_enabled);
+
+    // a reader running concurrently sees every slot either complete or reports it as torn
+    vector<float> const samples(100);
+    array<u8, frame_pixels> frame_buffer{};
+    array<u8, shared_ram_size> const ram{};
+    std::atomic<bool> done{false};
+    bool consistent = true;
+    u64 complete_reads{0};
+    std::thread consumer{[&] {
+        while (!done.load()) {
+            u64 frame{};
+            bool uniform = true;
+            bool const complete = reader->read_latest([&](shared_frame_slot const& slot) {
+                frame = slot.frame;
+                uniform = std::ranges::all_of(slot.frame_buffer, [&](u8 pixel) {
+                    return pixel == static_cast<u8>(slot.frame);
+                });
+            });
+            if (complete && (frame >= 5)) {
+                consistent = consistent && uniform;
+                ++complete_reads;
+            }
+            std::this_thread::yield();
+        }
+    }};
+    for (u64 frame = 5; frame < 2000; ++frame) {
+        frame_buffer.fill(static_cast<u8>(frame));
+        exporter->publish(frame_buffer.data(), samples, ram);
+        if ((frame % 16) == 0) {
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    consumer.join();
+    CHECK(consistent);
+    CHECK(complete_reads > 0);
+
+    exporter.reset();
+    CHECK_FALSE(shared_memory_reader::open(name));
+}
+
+TEST_CASE("spsc_ring") {
+    spsc_ring<int> ring{6};
+    CHECK(ring.capacity() == 8);
+
+    SECTION("wrap around") {
+        array<int, 8> out{};
+        for (int round = 0; round < 5; ++round) {
+            array<int, 5> const in{round, round + 1, round + 2, round + 3, round + 4};
+            CHECK(ring.push(in) == 5);
+            CHECK(ring.size() == 5);
+            CHECK(ring.push(in) == 3); // full
+            CHECK(ring.pop(out) == 8);
+            CHECK(std::ranges::equal(std::span{out}.first(5), in));
+            CHECK(std::ranges::equal(std::span{out}.last(3), std::span{in}.first(3)));
+            CHECK(ring.pop(out) == 0);
+        }
+    }
+
+    SECTION("two threads") {
+        // catch assertions are not thread safe
+        constexpr int count = 100000;
+        bool in_order = true;
+        std::thread consumer{[&] {
+            int expected = 0;
+            array<int, 3> out{};
+            while (expected < count) {
+                auto const popped = ring.pop(out);
+                for (auto const value : std::span{out}.first(popped)) {
+                    in_order = in_order && (value == expected++);
+                }
+                if (popped == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }};
+
+        int next = 0;
+        while (next < count) {
+            array<int, 5> in{};
+            std::ranges::generate(in, [value = next]() mutable { return value++; });
+            auto const size = std::min<std::size_t>(in.size(), count - next);
+            auto const pushed = ring.push(std::span{in}.first(size));
+            next += static_cast<int>(pushed);
+            if (pushed == 0) {
+                std::this_thread::yield();
+            }
+        }
+        consumer.join();
+        CHECK(in_order);
+        CHECK(ring.size() == 0);
+    }
+}
+
+TEST_CASE("thread_pool") {
+    thread_pool pool{4};
+    CHECK(pool.size() == 4);
+
+    for (std::size_t count : {0, 1, 3, 1000}) {
+        vector<std::atomic<int>> calls(count);
+        pool.parallel_for(count, [&](std::size_t i) { ++calls[i]; });
+        CHECK(std::ranges::all_of(calls, [](auto const& c) { return c == 1; }));
+    }
+}
+
+TEST_CASE("batch_runner") {
+    auto const rom = make_test_rom();
+    vector<batch_job> const jobs{
+        {.rom = rom, .frames = 3},
+        {.rom = rom, .input = {{}, {.joy1 = {.start = true}}}, .frames = 5},
+        {.rom = rom, .frames = 3},
+    };
+
+    thread_pool pool{2};
+    auto const results = run_batch(pool, jobs);
+    REQUIRE(results.size() == jobs.size());
+    CHECK(results[0].frame_hashes.size() == 3);
+    CHECK(results[1].frame_hashes.size() == 5);
+    CHECK(results[0].frame_hashes == results[2].frame_hashes);
+    CHECK(results[0].ram == results[2].ram);
+    CHECK(results[0].ram.size() == 2048);
+    CHECK(results[0].ram[0x10] != 0); // the test program counts in $10
+}
+
+TEST_CASE("segmented replay") {
+    auto const rom = make_test_rom();
+    nintendo_entertainment_system nes{cartridge{rom}};
+    movie m{.rom_hash = hash_rom(*rom)};
+    m.initial_state.resize(nes.state_size());
+    nes.save_state(m.initial_state);
+
+    vector<u64> frame_hashes;
+    vector<float> samples;
+    for (u8 frame = 0; frame < 10; ++frame) {
+        m.input.push_back({.joy1 = {.a = (frame % 3) == 0}});
+        nes.set_controller_states(m.input.back());
+        nes.run_single_frame();
+        m.state_hashes.push_back(nes.state_hash());
+        frame_hashes.push_back(
+            fnv1a(std::as_bytes(std::span{nes.frame_buffer(), std::size_t{256 * 240}})));
+        auto const frame_samples = nes.sample_buffer();
+        samples.insert(samples.end(), frame_samples.begin(), frame_samples.end());
+    }
+
+    thread_pool pool{2};
+    auto result = replay_segmented(pool, m, rom, {.segment_frames = 3, .audio = true});
+    REQUIRE(result);
+    CHECK(result->segment_count == 4);
+    CHECK(result->frame_hashes == frame_hashes);
+    CHECK(result->state_hashes == m.state_hashes);
+    CHECK_FALSE(result->first_desync);
+    CHECK(result->samples == samples);
+
+    m.state_hashes[7] ^= 1;
+    result = replay_segmented(pool, m, rom, {.segment_frames = 4});
+    REQUIRE(result);
+    CHECK(result->first_desync == 7);
+    CHECK(result->samples.empty());
+}
+
+TEST_CASE("vector_environment") {
+    thread_pool pool{2};
+    vector_environment environment{make_test_rom(), 3,
+                                   {.ram_observation = true, .max_episode_frames = 4}, pool};
+    REQUIRE(environment.observation_size() == (256 * 240) + 2048);
+    REQUIRE(environment.observations().size() == 3 * environment.observation_size());
+
+    vector<controller_states> const actions(3);
+    environment.step(actions);
+    auto const first = vector<u8>(environment.observation(0).begin(),
+                                  environment.observation(0).end());
+    CHECK(std::ranges::equal(environment.observation(1), first));
+    CHECK(std::ranges::none_of(environment.done(), [](u8 done) { return done != 0; }));
+
+    for (int i = 0; i < 3; ++i) {
+        environment.step(actions);
+    }
+    CHECK(std::ranges::all_of(environment.done(), [](u8 done) { return done != 0; }));
+
+    // the next step starts a new episode
+    environment.step(actions);
+    CHECK(std::ranges::equal(environment.observation(2), first));
+    CHECK(std::ranges::none_of(environment.done(), [](u8 done) { return done != 0; }));
+
+    // with max pooling the first step after a reset does not see the previous episode, so it is
+    // the same as without pooling
+    observation_format const unpooled{.width = 84, .height = 84, .color = color_mode::greyscale};
+    observation_format pooled = unpooled;
+    pooled.max_pool = true;
+    auto const colors = make_color_cycling_rom();
+    vector_environment pooling{colors, 1, {.frame_observation = pooled}, pool};
+    vector_environment reference{colors, 1, {.frame_observation = unpooled}, pool};
+    vector<controller_states> const action(1);
+    auto const step_both = [&] {
+        pooling.step(action);
+        reference.step(action);
+    };
+
+    step_both();
+    CHECK(std::ranges::equal(pooling.observation(0), reference.observation(0)));
+    auto const first_frame = vector<u8>(reference.observation(0).begin(),
+                                        reference.observation(0).end());
+    for (int i = 0; i < 30; ++i) {
+        step_both();
+    }
+    REQUIRE_FALSE(std::ranges::equal(reference.observation(0), first_frame));
+    pooling.reset();
+    reference.reset();
+    step_both();
+    CHECK(std::ranges::equal(pooling.observation(0), reference.observation(0)));
+}
+
+TEST_CASE("observation_encoder") {
+    // left half white (0x30), right half black (0x0f)
+    vector<u8> frame(256 * 240);
+    for (std::size_t y = 0; y < 240; ++y) {
+        std::fill_n(frame.begin() + static_cast<std::ptrdiff_t>(y * 256), 128, u8{0x30});
+        std::fill_n(frame.begin() + static_cast<std::ptrdiff_t>(y * 256 + 128), 128, u8{0x0f});
+    }
+
+    observation_encoder const greyscale{
+        {.width = 84, .height = 84, .color = color_mode::greyscale}};
+    vector<u8> observation(greyscale.format().size());
+    REQUIRE(observation.size() == 84 * 84);
+    greyscale.encode(frame.data(), observation);
+    CHECK(observation[0] == greyscale_palette[0x30]);
+    CHECK(observation[83] == 0);
+
+    observation_encoder const three_columns{
+        {.width = 3, .height = 1, .color = color_mode::greyscale}};
+    vector<u8> averages(3);
+    three_columns.encode(frame.data(), averages);
+    CHECK(averages[1] == (greyscale_palette[0x30] * 43 + 42) / 85); // 43 of 85 columns white
+
+    observation_encoder const rgb{{.width = 2, .height = 1, .color = color_mode::rgb}};
+    vector<u8> colors(rgb.format().size());
+    rgb.encode(frame.data(), colors);
+    CHECK(colors == vector<u8>{236, 238, 236, 0, 0, 0});
+
+    observation_encoder const palette{{.width = 4, .height = 2}};
+    vector<u8> indices(palette.format().size());
+    palette.encode(frame.data(), indices);
+    CHECK(indices == vector<u8>{0x30, 0x30, 0x0f, 0x0f, 0x30, 0x30, 0x0f, 0x0f});
+
+    vector<u8> previous{5, 1, 7};
+    vector<u8> pooled{3, 4, 7};
+    max_pool(pooled, previous);
+    CHECK(pooled == vector<u8>{5, 4, 7});
+    CHECK(previous == vector<u8>{3, 4, 7});
+}